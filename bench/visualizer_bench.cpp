@@ -0,0 +1,306 @@
+// Visualizer pipeline benchmark: capture ring -> spectrum -> bar motion ->
+// bars node, the same steps the player's visualizer thread and the UI run.
+//
+//   visualizer_bench [--pcm FILE] [--bars N] [--fps N] [--style blocks|braille]
+//
+// FILE is raw interleaved stereo float32 at 44.1 kHz (e.g. from
+// `ffmpeg -i song.mp3 -f f32le -ac 2 -ar 44100 song.f32`); without it a
+// synthetic mix of tones and noise is used. Reports throughput, cost and
+// heap allocations per frame for each stage, and the latency from a test
+// tone's onset to its bar reaching half height, on a simulated clock that
+// delivers capture fragments and ticks like the real threads do (server
+// and terminal latency not included).
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <ftxui/dom/node.hpp>
+#include <ftxui/screen/screen.hpp>
+
+#include "../src/audio/visualizer_step.hpp"
+#include "../src/core/visualizer_bars.hpp"
+
+// ─── Allocation counting ────────────────────────────────────────────────────
+
+static std::atomic<uint64_t> allocations{0};
+
+void *operator new(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void *p = std::malloc(size ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+constexpr int SAMPLE_RATE = 44100;
+constexpr int CHANNELS = 2;
+// Capture fragment, as AudioCapture asks PulseAudio for
+constexpr size_t FRAGMENT_FRAMES = 512;
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+  std::string pcm_path;
+  int bars = 32;
+  int fps = 30;
+  VisualizerBars::Style style = VisualizerBars::Style::Blocks;
+};
+
+Options parse_args(int argc, char **argv) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "--pcm" && has_value) {
+      options.pcm_path = argv[++i];
+    } else if (arg == "--bars" && has_value) {
+      options.bars = std::clamp(std::atoi(argv[++i]), 1, 512);
+    } else if (arg == "--fps" && has_value) {
+      options.fps = std::clamp(std::atoi(argv[++i]), 1, 240);
+    } else if (arg == "--style" && has_value) {
+      options.style = VisualizerBars::parse_style(argv[++i]);
+    } else {
+      std::fprintf(stderr,
+                   "usage: %s [--pcm FILE] [--bars N] [--fps N] [--style blocks|braille]\n",
+                   argv[0]);
+      std::exit(2);
+    }
+  }
+  return options;
+}
+
+std::vector<float> load_pcm(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    std::fprintf(stderr, "cannot open %s\n", path.c_str());
+    std::exit(1);
+  }
+  in.seekg(0, std::ios::end);
+  size_t samples = static_cast<size_t>(in.tellg()) / sizeof(float);
+  samples -= samples % CHANNELS;
+  in.seekg(0);
+  std::vector<float> pcm(samples);
+  in.read(reinterpret_cast<char *>(pcm.data()), samples * sizeof(float));
+  return pcm;
+}
+
+// Ten seconds of a few drifting tones over soft noise
+std::vector<float> synthetic_pcm() {
+  const double pi = std::acos(-1.0);
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> noise(-0.05f, 0.05f);
+  std::vector<float> pcm(static_cast<size_t>(SAMPLE_RATE) * 10 * CHANNELS);
+  for (size_t f = 0; f < pcm.size() / CHANNELS; f++) {
+    double t = static_cast<double>(f) / SAMPLE_RATE;
+    double v = 0.3 * std::sin(2 * pi * (80 + 20 * std::sin(t)) * t) +
+               0.2 * std::sin(2 * pi * 440 * t) * (0.5 + 0.5 * std::sin(3 * t)) +
+               0.1 * std::sin(2 * pi * 3000 * t);
+    pcm[f * CHANNELS] = static_cast<float>(v) + noise(rng);
+    pcm[f * CHANNELS + 1] = static_cast<float>(v) + noise(rng);
+  }
+  return pcm;
+}
+
+// One visualizer thread plus bars panel, stepped by hand
+struct Pipeline {
+  SampleRing ring{SAMPLE_RATE * CHANNELS / 2};
+  AudioVisualizer visualizer;
+  VisualizerStep step;
+  std::shared_ptr<const std::vector<double>> frame;
+  std::shared_ptr<VisualizerBars> node;
+  ftxui::Screen screen;
+
+  // Per-stage totals
+  double spectrum_secs = 0.0, motion_secs = 0.0, render_secs = 0.0;
+  uint64_t spectrum_allocs = 0, motion_allocs = 0, render_allocs = 0;
+  uint64_t frames = 0, samples = 0;
+
+  Pipeline(const Options &options, int width)
+      : visualizer(options.bars, SAMPLE_RATE, CHANNELS),
+        node(std::make_shared<VisualizerBars>([this] { return frame; }, nullptr, options.style,
+                                              options.bars)),
+        screen(width, 8) {
+    step.configure(visualizer, CHANNELS);
+  }
+
+  // One visualizer tick `dt` seconds after the last
+  void tick(double dt) {
+    auto start = Clock::now();
+    uint64_t before = allocations.load();
+    samples += step.analyze(ring, visualizer, dt);
+    auto spectrum_done = Clock::now();
+    uint64_t after_spectrum = allocations.load();
+
+    // Includes publishing the frame, which the player does too
+    frame = std::make_shared<const std::vector<double>>(step.advance(dt));
+    auto motion_done = Clock::now();
+    uint64_t after_motion = allocations.load();
+
+    screen.Clear();
+    ftxui::Render(screen, node);
+    auto render_done = Clock::now();
+    uint64_t after_render = allocations.load();
+
+    spectrum_secs += std::chrono::duration<double>(spectrum_done - start).count();
+    motion_secs += std::chrono::duration<double>(motion_done - spectrum_done).count();
+    render_secs += std::chrono::duration<double>(render_done - motion_done).count();
+    spectrum_allocs += after_spectrum - before;
+    motion_allocs += after_motion - after_spectrum;
+    render_allocs += after_render - after_motion;
+    frames++;
+  }
+};
+
+void report_stage(const char *name, double secs, uint64_t allocs, uint64_t frames) {
+  std::printf("  %-9s %9.2f us/frame  %6.2f allocs/frame\n", name, secs * 1e6 / frames,
+              static_cast<double>(allocs) / frames);
+}
+
+// Pushes the whole clip through as fast as possible, one capture fragment
+// per tick, for throughput and per-stage cost
+void run_throughput(const Options &options, const std::vector<float> &pcm, int width) {
+  Pipeline pipeline(options, width);
+  const size_t fragment = FRAGMENT_FRAMES * CHANNELS;
+  const double dt = 1.0 / options.fps;
+
+  // Ring conversion on its own
+  std::vector<double> converted(fragment);
+  auto start = Clock::now();
+  uint64_t before = allocations.load();
+  for (size_t pos = 0; pos + fragment <= pcm.size(); pos += fragment) {
+    pipeline.ring.write(pcm.data() + pos, fragment);
+    pipeline.ring.read(converted.data(), fragment);
+  }
+  double ring_secs = std::chrono::duration<double>(Clock::now() - start).count();
+  uint64_t ring_allocs = allocations.load() - before;
+  double clip_samples = static_cast<double>(pcm.size() - pcm.size() % fragment);
+
+  start = Clock::now();
+  for (size_t pos = 0; pos + fragment <= pcm.size(); pos += fragment) {
+    pipeline.ring.write(pcm.data() + pos, fragment);
+    pipeline.tick(dt);
+  }
+  double total_secs = std::chrono::duration<double>(Clock::now() - start).count();
+
+  std::printf("throughput (%llu frames of %zu samples)\n",
+              static_cast<unsigned long long>(pipeline.frames), fragment);
+  std::printf("  ring      %9.1f Msamples/s  %6llu allocs\n", clip_samples / ring_secs / 1e6,
+              static_cast<unsigned long long>(ring_allocs));
+  std::printf("  pipeline  %9.1f Msamples/s  (%.1fx real time)\n",
+              pipeline.samples / total_secs / 1e6,
+              clip_samples / CHANNELS / SAMPLE_RATE / total_secs);
+  report_stage("spectrum", pipeline.spectrum_secs, pipeline.spectrum_allocs, pipeline.frames);
+  report_stage("motion", pipeline.motion_secs, pipeline.motion_allocs, pipeline.frames);
+  report_stage("render", pipeline.render_secs, pipeline.render_allocs, pipeline.frames);
+}
+
+// Silence, then a 1 kHz tone starting `offset` seconds in; returns the
+// simulated seconds until the bar it lands in reaches half height
+double tone_latency(const Options &options, int width, int bar, double offset) {
+  const double pi = std::acos(-1.0);
+  Pipeline pipeline(options, width);
+  const double dt = 1.0 / options.fps;
+  std::vector<float> fragment(FRAGMENT_FRAMES * CHANNELS);
+  size_t next_frame = 0; // first frame of the next fragment
+
+  for (double now = dt; now < offset + 2.0; now += dt) {
+    // Fragments whose last frame has been played by `now`
+    while ((next_frame + FRAGMENT_FRAMES) / static_cast<double>(SAMPLE_RATE) <= now) {
+      for (size_t f = 0; f < FRAGMENT_FRAMES; f++) {
+        double t = static_cast<double>(next_frame + f) / SAMPLE_RATE;
+        float v = t >= offset ? static_cast<float>(0.5 * std::sin(2 * pi * 1000 * t)) : 0.0f;
+        fragment[f * CHANNELS] = fragment[f * CHANNELS + 1] = v;
+      }
+      pipeline.ring.write(fragment.data(), fragment.size());
+      next_frame += FRAGMENT_FRAMES;
+    }
+    pipeline.tick(dt);
+    if (now >= offset && (*pipeline.frame)[bar] >= 0.5) {
+      return now - offset;
+    }
+  }
+  return -1.0;
+}
+
+// Bar a steady 1 kHz tone settles in
+int tone_bar(const Options &options, int width) {
+  const double pi = std::acos(-1.0);
+  Pipeline pipeline(options, width);
+  std::vector<float> fragment(FRAGMENT_FRAMES * CHANNELS);
+  for (int i = 0; i < 60; i++) {
+    for (size_t f = 0; f < FRAGMENT_FRAMES; f++) {
+      double t = static_cast<double>(i * FRAGMENT_FRAMES + f) / SAMPLE_RATE;
+      fragment[f * CHANNELS] = fragment[f * CHANNELS + 1] =
+          static_cast<float>(0.5 * std::sin(2 * pi * 1000 * t));
+    }
+    pipeline.ring.write(fragment.data(), fragment.size());
+    pipeline.tick(1.0 / options.fps);
+  }
+  const auto &levels = *pipeline.frame;
+  return static_cast<int>(std::max_element(levels.begin(), levels.end()) - levels.begin());
+}
+
+void run_latency(const Options &options, int width) {
+  int bar = tone_bar(options, width);
+  // Onsets spread over one tick, since where a tone starts relative to
+  // the tick and fragment boundaries matters
+  std::vector<double> results;
+  for (int i = 0; i < 16; i++) {
+    double latency = tone_latency(options, width, bar, 0.5 + i / (16.0 * options.fps));
+    if (latency >= 0) {
+      results.push_back(latency * 1000.0);
+    }
+  }
+  std::printf("latency (1 kHz tone -> bar %d at half height, %d fps)\n", bar, options.fps);
+  if (results.empty()) {
+    std::printf("  bar never responded\n");
+    return;
+  }
+  std::sort(results.begin(), results.end());
+  double mean = 0.0;
+  for (double r : results) {
+    mean += r;
+  }
+  mean /= results.size();
+  std::printf("  min %.1f ms  mean %.1f ms  max %.1f ms\n", results.front(), mean,
+              results.back());
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options options = parse_args(argc, argv);
+  std::vector<float> pcm = options.pcm_path.empty() ? synthetic_pcm() : load_pcm(options.pcm_path);
+  int width = options.style == VisualizerBars::Style::Braille ? (options.bars + 1) / 2
+                                                               : options.bars * 2;
+
+#ifdef WITH_CAVA
+  const char *engine = "cava";
+#else
+  const char *engine = "built-in";
+#endif
+  std::printf("%s spectrum, %d bars, %s, %s input (%.1f s)\n\n", engine, options.bars,
+              options.style == VisualizerBars::Style::Braille ? "braille" : "blocks",
+              options.pcm_path.empty() ? "synthetic" : options.pcm_path.c_str(),
+              static_cast<double>(pcm.size()) / CHANNELS / SAMPLE_RATE);
+
+  run_throughput(options, pcm, width);
+  std::printf("\n");
+  run_latency(options, width);
+  return 0;
+}
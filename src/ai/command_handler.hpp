@@ -3,8 +3,10 @@
 #include <string>
 #include <vector>
 #include <sstream>
+#include <functional>
 #include <memory>
 #include "json_output.hpp"
+#include "../audio/playback_events.hpp"
 
 // Forward declarations
 class MusicPlayer;
@@ -16,25 +18,25 @@ namespace ai {
 
 class CommandHandler {
 private:
-    std::shared_ptr<MusicPlayer> player;
+    // Called on first use, so commands that never play (search, help)
+    // do not start mpv
+    std::function<std::shared_ptr<MusicPlayer>()> player_provider;
     SoundCloud& soundcloud;
     Saavn& saavn;
 
-    // Current playback state
-    std::vector<Track> current_tracks;  // Fetched next tracks (like UI playlist)
-    int current_index = -1;
-    std::string current_track_name;
-    std::string current_artist;
-    std::string current_source;  // "saavn", "soundcloud", or "lastfm"
+    // Queue and current track live in the player (player()->queue(),
+    // player()->snapshot()); nothing is mirrored here.
+    std::shared_ptr<MusicPlayer> player() { return player_provider(); }
 
 public:
     CommandHandler(
-        std::shared_ptr<MusicPlayer> player_ptr,
+        std::function<std::shared_ptr<MusicPlayer>()> provider,
         SoundCloud& sc,
         Saavn& sv
-    ) : player(player_ptr), soundcloud(sc), saavn(sv) {}
+    ) : player_provider(std::move(provider)), soundcloud(sc), saavn(sv) {}
 
-    // Execute a command and return JSON response
+    // Execute a command and return JSON response. Safe to call from
+    // several threads: state lives in the player, which locks itself.
     std::string execute(const std::string& command) {
         std::istringstream iss(command);
         std::string cmd;
@@ -89,11 +91,44 @@ public:
         }
     }
 
+    // Streams playback changes to `emit` as JSON lines (create_event) until
+    // the returned function is called. `args` is the optional minimum
+    // interval between position ticks in ms (default 1000, 0 = none).
+    // `emit` runs on the player's event thread: it must only queue, and
+    // stay valid until it is no longer called, which may be shortly after
+    // unsubscribing.
+    std::function<void()> subscribe(const std::string& args,
+                                    std::function<void(const std::string&)> emit) {
+        int interval_ms = 1000;
+        std::istringstream iss(args);
+        iss >> interval_ms;
+        int64_t interval = static_cast<int64_t>(std::max(interval_ms, 0)) * 1000000;
+
+        auto p = player();
+        // Position events come from the event thread only
+        auto last_tick = std::make_shared<int64_t>(0);
+        int id = p->playback_events().subscribe(
+            [interval, last_tick, emit](const PlaybackEvent& event) {
+                if (event.kind == PlaybackEvent::Kind::Position) {
+                    int64_t now = PlaybackSnapshot::clock_now();
+                    if (interval == 0 || now - *last_tick < interval) {
+                        return;
+                    }
+                    *last_tick = now;
+                }
+                const auto& snap = *event.snapshot;
+                emit(JsonOutput::create_event(PlaybackEvent::name(event.kind), snap.track,
+                                              snap.interpolated_position(), snap.duration,
+                                              snap.paused, event.text));
+            });
+        return [p, id] { p->playback_events().unsubscribe(id); };
+    }
+
 private:
     std::string handle_play(const std::string& query) {
         if (query.empty()) {
             // Resume if paused
-            player->resume();
+            player()->resume();
             return JsonOutput::create_success("Resumed playback");
         }
 
@@ -109,9 +144,6 @@ private:
 
         // Get first result
         Track selected_track = search_results[0];
-        current_track_name = selected_track.name;
-        current_artist = selected_track.artist;
-        current_source = selected_track.source;
 
         // Fetch next tracks like the UI does (line 737-779 in main.cpp)
         std::vector<Track> next_tracks;
@@ -128,71 +160,44 @@ private:
         }
 
         // Build playlist: selected track + next tracks
-        current_tracks.clear();
-        current_tracks.push_back(selected_track);
-        current_tracks.insert(current_tracks.end(), next_tracks.begin(), next_tracks.end());
-        current_index = 0;
-
-        // Create playlist URLs for MPV
-        std::vector<std::string> playlist_urls;
-        for (const auto& track : current_tracks) {
-            playlist_urls.push_back(track.url);
-        }
-
-        // Use create_playlist like the UI does (line 779 in main.cpp)
-        player->create_playlist(playlist_urls);
+        next_tracks.insert(next_tracks.begin(), selected_track);
+        player()->create_playlist(next_tracks);
 
         return JsonOutput::create_success("Now playing: " + selected_track.name + " - " + selected_track.artist);
     }
 
     std::string handle_pause() {
-        player->pause();
+        player()->pause();
         return JsonOutput::create_success("Playback paused");
     }
 
     std::string handle_resume() {
-        player->resume();
+        player()->resume();
         return JsonOutput::create_success("Playback resumed");
     }
 
     std::string handle_next() {
-        if (current_tracks.empty() || current_index < 0) {
+        if (player()->queue().empty()) {
             return JsonOutput::create_error("No active playlist");
         }
 
-        // Move to next track in playlist
-        current_index = (current_index + 1) % current_tracks.size();
-
-        // Use player's next_track() method which handles MPV playlist navigation
-        player->next_track();
-
-        // Update current track info
-        current_track_name = current_tracks[current_index].name;
-        current_artist = current_tracks[current_index].artist;
-
-        return JsonOutput::create_success("Playing next: " + current_track_name + " - " + current_artist);
+        player()->next_track();
+        auto track = player()->queue().current_track();
+        return JsonOutput::create_success("Playing next: " + track->name + " - " + track->artist);
     }
 
     std::string handle_previous() {
-        if (current_tracks.empty() || current_index < 0) {
+        if (player()->queue().empty()) {
             return JsonOutput::create_error("No active playlist");
         }
 
-        // Move to previous track in playlist
-        current_index = (current_index - 1 + current_tracks.size()) % current_tracks.size();
-
-        // Manually play the previous track (player doesn't have previous_track method)
-        player->play(current_tracks[current_index].url);
-
-        // Update current track info
-        current_track_name = current_tracks[current_index].name;
-        current_artist = current_tracks[current_index].artist;
-
-        return JsonOutput::create_success("Playing previous: " + current_track_name + " - " + current_artist);
+        player()->previous_track();
+        auto track = player()->queue().current_track();
+        return JsonOutput::create_success("Playing previous: " + track->name + " - " + track->artist);
     }
 
     std::string handle_stop() {
-        player->stop();
+        player()->stop();
         return JsonOutput::create_success("Playback stopped");
     }
 
@@ -206,16 +211,18 @@ private:
     }
 
     std::string handle_status() {
-        std::string status = player->is_playing_state() ? "playing" :
-                           player->is_paused_state() ? "paused" : "stopped";
+        // One snapshot so all fields describe the same moment
+        auto snap = player()->snapshot();
+        std::string status = snap->playing() ? "playing" :
+                           snap->loaded ? "paused" : "stopped";
 
         return JsonOutput::create_status(
             status,
-            current_track_name,
-            current_artist,
-            player->get_position(),
-            player->get_duration(),
-            player->get_volume()
+            snap->track.name,
+            snap->track.artist,
+            snap->interpolated_position(),
+            snap->duration,
+            snap->volume
         );
     }
 
@@ -224,12 +231,12 @@ private:
             return JsonOutput::create_error("Volume must be between 0 and 100");
         }
 
-        player->set_volume(vol);
+        player()->set_volume(vol);
         return JsonOutput::create_success("Volume set to " + std::to_string(vol));
     }
 
     std::string handle_seek(double pos) {
-        player->seek(pos);
+        player()->seek(pos);
         return JsonOutput::create_success("Seeked to " + std::to_string(pos) + " seconds");
     }
 
@@ -1,7 +1,5 @@
 #pragma once
 
-#include <rapidjson/document.h>
-#include <rapidjson/prettywriter.h>
 #include <rapidjson/stringbuffer.h>
 #include <rapidjson/writer.h>
 #include <string>
@@ -10,8 +8,25 @@
 
 namespace ai {
 
+// Command results, written straight through a rapidjson Writer into a
+// per-thread buffer that is reused across calls; no DOM is built.
 class JsonOutput {
 public:
+    using JsonWriter = rapidjson::Writer<rapidjson::StringBuffer>;
+
+    // Runs `fn` on a writer over this thread's buffer and returns the text
+    template <typename Fn> static std::string build(Fn&& fn) {
+        thread_local rapidjson::StringBuffer buffer;
+        buffer.Clear();
+        JsonWriter writer(buffer);
+        fn(writer);
+        return std::string(buffer.GetString(), buffer.GetSize());
+    }
+
+    static void write_string(JsonWriter& writer, const std::string& value) {
+        writer.String(value.c_str(), static_cast<rapidjson::SizeType>(value.size()));
+    }
+
     // Create status JSON
     static std::string create_status(
         const std::string& status,
@@ -21,102 +36,125 @@ public:
         double duration,
         int volume
     ) {
-        rapidjson::Document doc;
-        doc.SetObject();
-        auto& allocator = doc.GetAllocator();
-
-        doc.AddMember("status", rapidjson::Value(status.c_str(), allocator), allocator);
-        doc.AddMember("track", rapidjson::Value(track_name.c_str(), allocator), allocator);
-        doc.AddMember("artist", rapidjson::Value(artist.c_str(), allocator), allocator);
-        doc.AddMember("position", position, allocator);
-        doc.AddMember("duration", duration, allocator);
-        doc.AddMember("volume", volume, allocator);
-
-        return document_to_string(doc);
+        return build([&](JsonWriter& writer) {
+            writer.StartObject();
+            writer.Key("status");
+            write_string(writer, status);
+            writer.Key("track");
+            write_string(writer, track_name);
+            writer.Key("artist");
+            write_string(writer, artist);
+            writer.Key("position");
+            writer.Double(position);
+            writer.Key("duration");
+            writer.Double(duration);
+            writer.Key("volume");
+            writer.Int(volume);
+            writer.EndObject();
+        });
     }
 
     // Create search results JSON
     static std::string create_search_results(const std::vector<Track>& tracks) {
-        rapidjson::Document doc;
-        doc.SetObject();
-        auto& allocator = doc.GetAllocator();
-
-        rapidjson::Value results(rapidjson::kArrayType);
-
-        for (const auto& track : tracks) {
-            rapidjson::Value track_obj(rapidjson::kObjectType);
-            track_obj.AddMember("name", rapidjson::Value(track.name.c_str(), allocator), allocator);
-            track_obj.AddMember("artist", rapidjson::Value(track.artist.c_str(), allocator), allocator);
-            track_obj.AddMember("url", rapidjson::Value(track.url.c_str(), allocator), allocator);
-            track_obj.AddMember("id", rapidjson::Value(track.id.c_str(), allocator), allocator);
-            track_obj.AddMember("source", rapidjson::Value(track.source.c_str(), allocator), allocator);
-            results.PushBack(track_obj, allocator);
-        }
-
-        doc.AddMember("results", results, allocator);
-        doc.AddMember("count", static_cast<int>(tracks.size()), allocator);
-
-        return document_to_string(doc);
+        return build([&](JsonWriter& writer) {
+            writer.StartObject();
+            writer.Key("results");
+            writer.StartArray();
+            for (const auto& track : tracks) {
+                writer.StartObject();
+                writer.Key("name");
+                write_string(writer, track.name);
+                writer.Key("artist");
+                write_string(writer, track.artist);
+                writer.Key("url");
+                write_string(writer, track.url);
+                writer.Key("id");
+                write_string(writer, track.id);
+                writer.Key("source");
+                write_string(writer, track.source);
+                writer.EndObject();
+            }
+            writer.EndArray();
+            writer.Key("count");
+            writer.Int(static_cast<int>(tracks.size()));
+            writer.EndObject();
+        });
     }
 
     // Create success response
     static std::string create_success(const std::string& message) {
-        rapidjson::Document doc;
-        doc.SetObject();
-        auto& allocator = doc.GetAllocator();
-
-        doc.AddMember("success", true, allocator);
-        doc.AddMember("message", rapidjson::Value(message.c_str(), allocator), allocator);
-
-        return document_to_string(doc);
+        return build([&](JsonWriter& writer) {
+            writer.StartObject();
+            writer.Key("success");
+            writer.Bool(true);
+            writer.Key("message");
+            write_string(writer, message);
+            writer.EndObject();
+        });
     }
 
     // Create error response
     static std::string create_error(const std::string& error) {
-        rapidjson::Document doc;
-        doc.SetObject();
-        auto& allocator = doc.GetAllocator();
-
-        doc.AddMember("success", false, allocator);
-        doc.AddMember("error", rapidjson::Value(error.c_str(), allocator), allocator);
+        return build([&](JsonWriter& writer) {
+            writer.StartObject();
+            writer.Key("success");
+            writer.Bool(false);
+            writer.Key("error");
+            write_string(writer, error);
+            writer.EndObject();
+        });
+    }
 
-        return document_to_string(doc);
+    // Create playback event JSON, one per subscription notification
+    static std::string create_event(
+        const std::string& event,
+        const Track& track,
+        double position,
+        double duration,
+        bool paused,
+        const std::string& text
+    ) {
+        return build([&](JsonWriter& writer) {
+            writer.StartObject();
+            writer.Key("event");
+            write_string(writer, event);
+            writer.Key("track");
+            write_string(writer, track.name);
+            writer.Key("artist");
+            write_string(writer, track.artist);
+            writer.Key("position");
+            writer.Double(position);
+            writer.Key("duration");
+            writer.Double(duration);
+            writer.Key("paused");
+            writer.Bool(paused);
+            if (!text.empty()) {
+                writer.Key("text");
+                write_string(writer, text);
+            }
+            writer.EndObject();
+        });
     }
 
     // Create playlist JSON
     static std::string create_playlist(const std::vector<Track>& tracks) {
-        rapidjson::Document doc;
-        doc.SetObject();
-        auto& allocator = doc.GetAllocator();
-
-        rapidjson::Value playlist(rapidjson::kArrayType);
-
-        for (const auto& track : tracks) {
-            rapidjson::Value track_obj(rapidjson::kObjectType);
-            track_obj.AddMember("name", rapidjson::Value(track.name.c_str(), allocator), allocator);
-            track_obj.AddMember("artist", rapidjson::Value(track.artist.c_str(), allocator), allocator);
-            playlist.PushBack(track_obj, allocator);
-        }
-
-        doc.AddMember("playlist", playlist, allocator);
-        doc.AddMember("count", static_cast<int>(tracks.size()), allocator);
-
-        return document_to_string(doc);
-    }
-
-private:
-    static std::string document_to_string(const rapidjson::Document& doc, bool pretty = false) {
-        rapidjson::StringBuffer buffer;
-
-        if (pretty) {
-            rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(buffer);
-            doc.Accept(writer);
-        } else {
-            rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
-            doc.Accept(writer);
-        }
-
-        return buffer.GetString();
+        return build([&](JsonWriter& writer) {
+            writer.StartObject();
+            writer.Key("playlist");
+            writer.StartArray();
+            for (const auto& track : tracks) {
+                writer.StartObject();
+                writer.Key("name");
+                write_string(writer, track.name);
+                writer.Key("artist");
+                write_string(writer, track.artist);
+                writer.EndObject();
+            }
+            writer.EndArray();
+            writer.Key("count");
+            writer.Int(static_cast<int>(tracks.size()));
+            writer.EndObject();
+        });
     }
 };
 
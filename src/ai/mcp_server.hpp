@@ -1,146 +1,413 @@
 #pragma once
 
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <map>
 #include <string>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
 #include <rapidjson/document.h>
 #include <rapidjson/writer.h>
 #include <rapidjson/stringbuffer.h>
+#include <sys/uio.h>
+#include <unistd.h>
 #include "command_handler.hpp"
+#include "json_output.hpp"
 
 namespace ai {
 
+// Runs jobs one at a time, in submission order, on its own thread
+class WorkerLane {
+private:
+    std::mutex lane_mutex;
+    std::condition_variable wake;
+    std::deque<std::function<void()>> jobs;
+    bool stopping = false;
+    std::thread worker;
+
+    void work() {
+        for (;;) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(lane_mutex);
+                wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (jobs.empty()) {
+                    return;
+                }
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            job();
+        }
+    }
+
+public:
+    WorkerLane() : worker([this] { work(); }) {}
+
+    // Finishes queued jobs first
+    ~WorkerLane() {
+        {
+            std::lock_guard<std::mutex> lock(lane_mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        worker.join();
+    }
+
+    WorkerLane(const WorkerLane&) = delete;
+    WorkerLane& operator=(const WorkerLane&) = delete;
+
+    void submit(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lock(lane_mutex);
+            jobs.push_back(std::move(job));
+        }
+        wake.notify_one();
+    }
+};
+
+// MCP over stdio. Tool calls run on worker lanes and their responses are
+// written as they finish, matched to requests by id: playback controls,
+// plays and searches each have a lane, so "music_pause" never waits for a
+// "music_play" that is still searching. Calls within a lane keep their
+// order. Batches (JSON arrays) are answered with one array once all of
+// their calls are done.
+//
+// music_subscribe pushes playback events (track changes, pause/resume,
+// lyric lines, end of queue, position ticks) as notifications/message
+// with logger "tuisic", so agents can follow playback without polling.
+//
+// Requests are parsed in place and responses streamed through a rapidjson
+// Writer (see JsonOutput::build); payloads that never change, such as the
+// tool list, are serialized once. Each message leaves in a single write.
 class MCPServer {
 private:
-    std::shared_ptr<CommandHandler> command_handler;
+    using JsonWriter = JsonOutput::JsonWriter;
+
+    // Runs a tuisic command, in-process or through the playback daemon.
+    // Called from several lanes at once.
+    std::function<std::string(const std::string&)> execute;
+
+    // Starts delivering playback event JSON for the given position tick
+    // interval (ms, as text); returns the function that stops it, or null
+    // when events are unavailable
+    using Subscriber = std::function<std::function<void()>(
+        const std::string&, std::function<void(const std::string&)>)>;
+    Subscriber subscribe;
+
+    // Receives one request's response; empty for notifications
+    using Reply = std::function<void(const std::string&)>;
+
+    // The session's music_subscribe, if any. Events may still arrive from
+    // the publisher after cancel(); `active` turns them away, under its
+    // own lock so none slips into a lane after the subscription ended.
+    struct Subscription {
+        std::mutex state_mutex;
+        bool active = true;
+        std::function<void()> cancel;
+    };
+    std::mutex subscription_mutex;
+    std::shared_ptr<Subscription> subscription;
+    // Set at end of input: music_subscribe calls still queued are refused
+    bool stopping = false;
+
+    // Id of replies to requests whose id could not be read
+    static constexpr const char* NULL_ID = "null";
+
+    // Interval of notifications/progress for calls that asked for them
+    static constexpr std::chrono::milliseconds PROGRESS_INTERVAL{1000};
+
+    std::mutex output_mutex;
+    // Declared last: destroyed first, draining pending calls while the
+    // members they use still exist
+    std::map<std::string, std::unique_ptr<WorkerLane>> lanes;
+
+    // One writev per message, so lanes never interleave their output
+    void write_line(const std::string& line) {
+        std::lock_guard<std::mutex> lock(output_mutex);
+        char newline = '\n';
+        size_t total = line.size() + 1;
+        size_t done = 0;
+        while (done < total) {
+            iovec parts[2];
+            int count = 0;
+            if (done < line.size()) {
+                parts[count++] = {const_cast<char*>(line.data()) + done, line.size() - done};
+            }
+            parts[count++] = {&newline, 1};
+            ssize_t n = writev(STDOUT_FILENO, parts, count);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return; // client went away
+            }
+            done += n;
+        }
+    }
+
+    // Quick playback controls must not queue behind network work
+    static const char* lane_for(const std::string& tool_name, const std::string& command) {
+        if (tool_name == "music_search") {
+            return "search";
+        }
+        if (tool_name == "music_play" && command != "play") {
+            return "play";
+        }
+        return "control";
+    }
 
 public:
     MCPServer(std::shared_ptr<CommandHandler> handler)
-        : command_handler(handler) {}
+        : execute([handler](const std::string& command) { return handler->execute(command); }),
+          subscribe([handler](const std::string& args, std::function<void(const std::string&)> emit) {
+              return handler->subscribe(args, std::move(emit));
+          }) {}
+
+    explicit MCPServer(std::function<std::string(const std::string&)> executor,
+                       Subscriber subscriber = nullptr)
+        : execute(std::move(executor)), subscribe(std::move(subscriber)) {}
 
-    // Start MCP server (reads from stdin, writes to stdout)
+    // Start MCP server (reads from stdin, writes to stdout). Returns at
+    // end of input once every pending call has answered.
     void run() {
+        for (const char* name : {"control", "play", "search", "events"}) {
+            lanes[name] = std::make_unique<WorkerLane>();
+        }
+
         std::string line;
         while (std::getline(std::cin, line)) {
             if (line.empty()) continue;
+            handle_line(line);
+        }
 
-            std::string response = handle_request(line);
-            std::cout << response << std::endl;
-            std::cout.flush();
+        // Pending calls finish first, and none of them may subscribe any
+        // more. The events lane outlives the subscription that feeds it.
+        {
+            std::lock_guard<std::mutex> lock(subscription_mutex);
+            stopping = true;
+        }
+        for (const char* name : {"control", "play", "search"}) {
+            lanes.at(name).reset();
         }
+        stop_subscription();
+        lanes.clear();
     }
 
 private:
-    std::string handle_request(const std::string& request_str) {
-        rapidjson::Document request;
-        if (request.Parse(request_str.c_str()).HasParseError()) {
-            return create_error_response(-1, "Invalid JSON");
+    // Parses `line` in place; nothing parsed outlives this call
+    void handle_line(std::string& line) {
+        rapidjson::Document message;
+        if (message.ParseInsitu(&line[0]).HasParseError()) {
+            write_line(create_error_response(NULL_ID, "Invalid JSON"));
+            return;
+        }
+        if (!message.IsArray()) {
+            handle_request(message, [this](const std::string& response) {
+                if (!response.empty()) {
+                    write_line(response);
+                }
+            });
+            return;
+        }
+        if (message.Empty()) {
+            write_line(create_error_response(NULL_ID, "Empty batch"));
+            return;
         }
 
-        if (!request.HasMember("method") || !request["method"].IsString()) {
-            return create_error_response(-1, "Missing method");
+        // Responses are gathered in the order calls finish; the last one
+        // writes the batch
+        struct Batch {
+            std::mutex batch_mutex;
+            std::vector<std::string> responses;
+            size_t remaining;
+        };
+        auto batch = std::make_shared<Batch>();
+        batch->remaining = message.Size();
+        Reply collect = [this, batch](const std::string& response) {
+            std::string out;
+            {
+                std::lock_guard<std::mutex> lock(batch->batch_mutex);
+                if (!response.empty()) {
+                    batch->responses.push_back(response);
+                }
+                if (--batch->remaining > 0 || batch->responses.empty()) {
+                    return; // pending, or notifications only
+                }
+                size_t size = 2;
+                for (const auto& r : batch->responses) {
+                    size += r.size() + 1;
+                }
+                out.reserve(size);
+                out += '[';
+                for (size_t i = 0; i < batch->responses.size(); i++) {
+                    if (i) {
+                        out += ',';
+                    }
+                    out += batch->responses[i];
+                }
+                out += ']';
+            }
+            write_line(out);
+        };
+        for (const auto& request : message.GetArray()) {
+            handle_request(request, collect);
+        }
+    }
+
+    // Calls `reply` exactly once, possibly later from a worker lane
+    void handle_request(const rapidjson::Value& request, const Reply& reply) {
+        if (!request.IsObject() || !request.HasMember("method") || !request["method"].IsString()) {
+            reply(create_error_response(NULL_ID, "Missing method"));
+            return;
         }
 
         std::string method = request["method"].GetString();
-        int id = request.HasMember("id") && request["id"].IsInt() ? request["id"].GetInt() : -1;
+        // Requests without an id are notifications and get no response
+        bool notification = !request.HasMember("id");
+        // String, number or null, echoed back exactly as sent
+        std::string id = notification ? NULL_ID : JsonOutput::build([&](JsonWriter& writer) {
+            request["id"].Accept(writer);
+        });
+        Reply respond = notification ? Reply([reply](const std::string&) { reply(""); }) : reply;
 
         if (method == "initialize") {
-            return handle_initialize(id);
+            std::cerr << "[MCP] Initialized with protocol version 2024-11-05" << std::endl;
+            respond(create_result_response(id, initialize_result()));
         }
         else if (method == "tools/list") {
-            return handle_tools_list(id);
+            respond(create_result_response(id, tools_list_result()));
         }
         else if (method == "tools/call") {
-            return handle_tools_call(id, request);
+            handle_tools_call(id, request, respond);
+        }
+        else if (notification) {
+            respond(""); // e.g. notifications/initialized
         }
         else {
-            return create_error_response(id, "Unknown method: " + method);
+            respond(create_error_response(id, "Unknown method: " + method));
         }
     }
 
-    std::string handle_initialize(int id) {
-        rapidjson::Document doc;
-        doc.SetObject();
-        auto& allocator = doc.GetAllocator();
-
-        doc.AddMember("jsonrpc", "2.0", allocator);
-        doc.AddMember("id", id, allocator);
-
-        rapidjson::Value result(rapidjson::kObjectType);
-
-        // Use the current MCP protocol version (date-based)
-        result.AddMember("protocolVersion", "2024-11-05", allocator);
-
-        rapidjson::Value serverInfo(rapidjson::kObjectType);
-        serverInfo.AddMember("name", "tuisic", allocator);
-        serverInfo.AddMember("version", "1.0.0", allocator);
-        result.AddMember("serverInfo", serverInfo, allocator);
-
-        rapidjson::Value capabilities(rapidjson::kObjectType);
-        rapidjson::Value tools(rapidjson::kObjectType);
-        capabilities.AddMember("tools", tools, allocator);
-        result.AddMember("capabilities", capabilities, allocator);
-
-        doc.AddMember("result", result, allocator);
-
-        std::cerr << "[MCP] Initialized with protocol version 2024-11-05" << std::endl;
-        return document_to_string(doc);
+    static const std::string& initialize_result() {
+        static const std::string result = JsonOutput::build([](JsonWriter& writer) {
+            writer.StartObject();
+            // Use the current MCP protocol version (date-based)
+            writer.Key("protocolVersion");
+            writer.String("2024-11-05");
+            writer.Key("serverInfo");
+            writer.StartObject();
+            writer.Key("name");
+            writer.String("tuisic");
+            writer.Key("version");
+            writer.String("1.0.0");
+            writer.EndObject();
+            writer.Key("capabilities");
+            writer.StartObject();
+            writer.Key("tools");
+            writer.StartObject();
+            writer.EndObject();
+            // Playback events arrive as log messages
+            writer.Key("logging");
+            writer.StartObject();
+            writer.EndObject();
+            writer.EndObject();
+            writer.EndObject();
+        });
+        return result;
     }
 
-    std::string handle_tools_list(int id) {
-        rapidjson::Document doc;
-        doc.SetObject();
-        auto& allocator = doc.GetAllocator();
+    static const std::string& tools_list_result() {
+        static const std::string result = JsonOutput::build([](JsonWriter& writer) {
+            writer.StartObject();
+            writer.Key("tools");
+            writer.StartArray();
 
-        doc.AddMember("jsonrpc", "2.0", allocator);
-        doc.AddMember("id", id, allocator);
+            // Define all available tools
+            write_tool(writer, "music_play", "Play a song or resume playback",
+                R"json({"query": {"type": "string", "description": "Song name, artist, or search query. Leave empty to resume."}})json");
 
-        rapidjson::Value result(rapidjson::kObjectType);
-        rapidjson::Value tools(rapidjson::kArrayType);
+            write_tool(writer, "music_pause", "Pause current playback", "{}");
 
-        // Define all available tools
-        tools.PushBack(create_tool("music_play", "Play a song or resume playback",
-            R"json({"query": {"type": "string", "description": "Song name, artist, or search query. Leave empty to resume."}})json", allocator), allocator);
+            write_tool(writer, "music_next", "Skip to next track", "{}");
 
-        tools.PushBack(create_tool("music_pause", "Pause current playback", "{}", allocator), allocator);
+            write_tool(writer, "music_previous", "Go to previous track", "{}");
 
-        tools.PushBack(create_tool("music_next", "Skip to next track", "{}", allocator), allocator);
+            write_tool(writer, "music_stop", "Stop playback", "{}");
 
-        tools.PushBack(create_tool("music_previous", "Go to previous track", "{}", allocator), allocator);
+            write_tool(writer, "music_search", "Search for music",
+                R"json({"query": {"type": "string", "description": "Search query for songs"}})json");
 
-        tools.PushBack(create_tool("music_stop", "Stop playback", "{}", allocator), allocator);
+            write_tool(writer, "music_status", "Get current playback status", "{}");
 
-        tools.PushBack(create_tool("music_search", "Search for music",
-            R"json({"query": {"type": "string", "description": "Search query for songs"}})json", allocator), allocator);
+            write_tool(writer, "music_volume", "Set volume level",
+                R"json({"level": {"type": "number", "description": "Volume level (0-100)"}})json");
 
-        tools.PushBack(create_tool("music_status", "Get current playback status", "{}", allocator), allocator);
+            write_tool(writer, "music_seek", "Seek to position",
+                R"json({"position": {"type": "number", "description": "Position in seconds"}})json");
 
-        tools.PushBack(create_tool("music_volume", "Set volume level",
-            R"json({"level": {"type": "number", "description": "Volume level (0-100)"}})json", allocator), allocator);
+            write_tool(writer, "music_subscribe",
+                "Follow playback: track changes, pause/resume, lyric lines, end of queue and position "
+                "ticks arrive as notifications/message from logger \"tuisic\"",
+                R"json({"position_interval_ms": {"type": "number", "description": "Minimum time between position ticks in ms (default 1000, 0 for none)"}})json");
 
-        tools.PushBack(create_tool("music_seek", "Seek to position",
-            R"json({"position": {"type": "number", "description": "Position in seconds"}})json", allocator), allocator);
+            write_tool(writer, "music_unsubscribe", "Stop following playback", "{}");
 
-        result.AddMember("tools", tools, allocator);
-        doc.AddMember("result", result, allocator);
-
-        return document_to_string(doc);
+            writer.EndArray();
+            writer.EndObject();
+        });
+        return result;
     }
 
-    std::string handle_tools_call(int id, rapidjson::Document& request) {
+    void handle_tools_call(const std::string& id, const rapidjson::Value& request, const Reply& reply) {
         if (!request.HasMember("params") || !request["params"].IsObject()) {
-            return create_error_response(id, "Missing params");
+            reply(create_error_response(id, "Missing params"));
+            return;
         }
 
         auto& params = request["params"];
         if (!params.HasMember("name") || !params["name"].IsString()) {
-            return create_error_response(id, "Missing tool name");
+            reply(create_error_response(id, "Missing tool name"));
+            return;
         }
 
         std::string tool_name = params["name"].GetString();
-        rapidjson::Value arguments(rapidjson::kObjectType);
-        if (params.HasMember("arguments") && params["arguments"].IsObject()) {
-            arguments.CopyFrom(params["arguments"], request.GetAllocator());
+        static const rapidjson::Value no_arguments(rapidjson::kObjectType);
+        const rapidjson::Value& arguments =
+            params.HasMember("arguments") && params["arguments"].IsObject() ? params["arguments"]
+                                                                             : no_arguments;
+
+        // Progress token from _meta, string or integer, kept serialized
+        // since the request it came from is gone by the time it is used
+        std::string progress_token;
+        if (params.HasMember("_meta") && params["_meta"].IsObject() &&
+            params["_meta"].HasMember("progressToken")) {
+            const auto& token = params["_meta"]["progressToken"];
+            if (token.IsString() || token.IsInt64()) {
+                progress_token = JsonOutput::build([&](JsonWriter& writer) { token.Accept(writer); });
+            }
+        }
+
+        if (tool_name == "music_subscribe" || tool_name == "music_unsubscribe") {
+            int interval = arguments.HasMember("position_interval_ms") &&
+                                   arguments["position_interval_ms"].IsNumber()
+                               ? static_cast<int>(arguments["position_interval_ms"].GetDouble())
+                               : 1000;
+            lanes.at("control")->submit([this, id, tool_name, interval, reply] {
+                std::string result = tool_name == "music_subscribe" ? start_subscription(interval)
+                                                                     : stop_subscription();
+                reply(create_tool_response(id, result));
+            });
+            return;
         }
 
         // Map tool names to commands
@@ -181,80 +448,185 @@ private:
             command = "seek " + std::to_string(pos);
         }
         else {
-            return create_error_response(id, "Unknown tool: " + tool_name);
+            reply(create_error_response(id, "Unknown tool: " + tool_name));
+            return;
         }
 
-        // Execute command
-        std::string result_str = command_handler->execute(command);
-
-        // Create MCP response
-        rapidjson::Document doc;
-        doc.SetObject();
-        auto& allocator = doc.GetAllocator();
-
-        doc.AddMember("jsonrpc", "2.0", allocator);
-        doc.AddMember("id", id, allocator);
-
-        rapidjson::Value result(rapidjson::kObjectType);
-        rapidjson::Value content(rapidjson::kArrayType);
+        lanes.at(lane_for(tool_name, command))->submit([this, id, command, progress_token, reply] {
+            reply(create_tool_response(id, run_command(command, progress_token)));
+        });
+    }
 
-        rapidjson::Value text_content(rapidjson::kObjectType);
-        text_content.AddMember("type", "text", allocator);
-        text_content.AddMember("text", rapidjson::Value(result_str.c_str(), allocator), allocator);
-        content.PushBack(text_content, allocator);
+    // Runs `command`, sending notifications/progress while it takes long
+    // when the caller asked for them
+    std::string run_command(const std::string& command, const std::string& progress_token) {
+        if (progress_token.empty()) {
+            return execute(command);
+        }
+        auto pending = std::async(std::launch::async, execute, command);
+        int ticks = 0;
+        while (pending.wait_for(PROGRESS_INTERVAL) != std::future_status::ready) {
+            write_line(create_progress_notification(progress_token, ++ticks, "Running: " + command));
+        }
+        return pending.get();
+    }
 
-        result.AddMember("content", content, allocator);
-        doc.AddMember("result", result, allocator);
+    // Replaces any previous subscription
+    std::string start_subscription(int position_interval_ms) {
+        if (!subscribe) {
+            return JsonOutput::create_error("Playback events are not available");
+        }
+        {
+            std::lock_guard<std::mutex> lock(subscription_mutex);
+            if (stopping) {
+                return JsonOutput::create_error("Server is shutting down");
+            }
+        }
+        stop_subscription();
+
+        auto sub = std::make_shared<Subscription>();
+        sub->cancel = subscribe(std::to_string(position_interval_ms),
+                                [this, sub](const std::string& event) {
+            std::lock_guard<std::mutex> lock(sub->state_mutex);
+            if (sub->active) {
+                lanes.at("events")->submit(
+                    [this, event] { write_line(create_event_notification(event)); });
+            }
+        });
+        if (!sub->cancel) {
+            return JsonOutput::create_error("Could not subscribe to playback events");
+        }
+        std::lock_guard<std::mutex> lock(subscription_mutex);
+        subscription = sub;
+        return JsonOutput::create_success("Subscribed to playback events");
+    }
 
-        return document_to_string(doc);
+    std::string stop_subscription() {
+        std::shared_ptr<Subscription> sub;
+        {
+            std::lock_guard<std::mutex> lock(subscription_mutex);
+            sub = std::exchange(subscription, nullptr);
+        }
+        if (!sub) {
+            return JsonOutput::create_success("No active subscription");
+        }
+        sub->cancel();
+        std::lock_guard<std::mutex> lock(sub->state_mutex);
+        sub->active = false;
+        return JsonOutput::create_success("Unsubscribed from playback events");
     }
 
-    rapidjson::Value create_tool(
-        const std::string& name,
-        const std::string& description,
-        const std::string& input_schema,
-        rapidjson::Document::AllocatorType& allocator
-    ) {
-        rapidjson::Value tool(rapidjson::kObjectType);
-        tool.AddMember("name", rapidjson::Value(name.c_str(), allocator), allocator);
-        tool.AddMember("description", rapidjson::Value(description.c_str(), allocator), allocator);
-
-        // Parse input schema
-        rapidjson::Document schema_doc;
-        schema_doc.Parse(input_schema.c_str());
-        rapidjson::Value input_schema_obj(rapidjson::kObjectType);
-        input_schema_obj.AddMember("type", "object", allocator);
-        input_schema_obj.AddMember("properties", rapidjson::Value(schema_doc, allocator), allocator);
-
-        tool.AddMember("inputSchema", input_schema_obj, allocator);
-
-        return tool;
+    // `event` is the serialized event object (JsonOutput::create_event)
+    std::string create_event_notification(const std::string& event) {
+        return JsonOutput::build([&](JsonWriter& writer) {
+            writer.StartObject();
+            writer.Key("jsonrpc");
+            writer.String("2.0");
+            writer.Key("method");
+            writer.String("notifications/message");
+            writer.Key("params");
+            writer.StartObject();
+            writer.Key("level");
+            writer.String("info");
+            writer.Key("logger");
+            writer.String("tuisic");
+            writer.Key("data");
+            writer.RawValue(event.c_str(), event.size(), rapidjson::kObjectType);
+            writer.EndObject();
+            writer.EndObject();
+        });
     }
 
-    std::string create_error_response(int id, const std::string& message) {
-        rapidjson::Document doc;
-        doc.SetObject();
-        auto& allocator = doc.GetAllocator();
+    // Opens a response object with its envelope; `id` is serialized JSON
+    static void begin_response(JsonWriter& writer, const std::string& id) {
+        writer.StartObject();
+        writer.Key("jsonrpc");
+        writer.String("2.0");
+        writer.Key("id");
+        writer.RawValue(id.c_str(), id.size(), rapidjson::kStringType);
+    }
 
-        doc.AddMember("jsonrpc", "2.0", allocator);
-        if (id >= 0) {
-            doc.AddMember("id", id, allocator);
-        }
+    // `result` is serialized JSON, embedded as is
+    std::string create_result_response(const std::string& id, const std::string& result) {
+        return JsonOutput::build([&](JsonWriter& writer) {
+            begin_response(writer, id);
+            writer.Key("result");
+            writer.RawValue(result.c_str(), result.size(), rapidjson::kObjectType);
+            writer.EndObject();
+        });
+    }
 
-        rapidjson::Value error(rapidjson::kObjectType);
-        error.AddMember("code", -32600, allocator);
-        error.AddMember("message", rapidjson::Value(message.c_str(), allocator), allocator);
+    std::string create_progress_notification(const std::string& token, int progress,
+                                             const std::string& message) {
+        return JsonOutput::build([&](JsonWriter& writer) {
+            writer.StartObject();
+            writer.Key("jsonrpc");
+            writer.String("2.0");
+            writer.Key("method");
+            writer.String("notifications/progress");
+            // No total: how long a search takes is not known up front
+            writer.Key("params");
+            writer.StartObject();
+            writer.Key("progressToken");
+            writer.RawValue(token.c_str(), token.size(), rapidjson::kStringType);
+            writer.Key("progress");
+            writer.Int(progress);
+            writer.Key("message");
+            JsonOutput::write_string(writer, message);
+            writer.EndObject();
+            writer.EndObject();
+        });
+    }
 
-        doc.AddMember("error", error, allocator);
+    // The command's own JSON result goes out as the text content
+    std::string create_tool_response(const std::string& id, const std::string& result_str) {
+        return JsonOutput::build([&](JsonWriter& writer) {
+            begin_response(writer, id);
+            writer.Key("result");
+            writer.StartObject();
+            writer.Key("content");
+            writer.StartArray();
+            writer.StartObject();
+            writer.Key("type");
+            writer.String("text");
+            writer.Key("text");
+            JsonOutput::write_string(writer, result_str);
+            writer.EndObject();
+            writer.EndArray();
+            writer.EndObject();
+            writer.EndObject();
+        });
+    }
 
-        return document_to_string(doc);
+    static void write_tool(JsonWriter& writer, const char* name, const char* description,
+                           const char* properties) {
+        writer.StartObject();
+        writer.Key("name");
+        writer.String(name);
+        writer.Key("description");
+        writer.String(description);
+        writer.Key("inputSchema");
+        writer.StartObject();
+        writer.Key("type");
+        writer.String("object");
+        writer.Key("properties");
+        writer.RawValue(properties, strlen(properties), rapidjson::kObjectType);
+        writer.EndObject();
+        writer.EndObject();
     }
 
-    std::string document_to_string(const rapidjson::Document& doc) {
-        rapidjson::StringBuffer buffer;
-        rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
-        doc.Accept(writer);
-        return buffer.GetString();
+    std::string create_error_response(const std::string& id, const std::string& message) {
+        return JsonOutput::build([&](JsonWriter& writer) {
+            begin_response(writer, id);
+            writer.Key("error");
+            writer.StartObject();
+            writer.Key("code");
+            writer.Int(-32600);
+            writer.Key("message");
+            JsonOutput::write_string(writer, message);
+            writer.EndObject();
+            writer.EndObject();
+        });
     }
 };
 
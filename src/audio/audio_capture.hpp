@@ -1,26 +1,60 @@
 #pragma once
 
-#ifdef WITH_CAVA
+#ifdef WITH_VISUALIZER
 
 #include <pulse/pulseaudio.h>
-#include <pulse/simple.h>
+#include <unistd.h>
 #include <atomic>
 #include <functional>
-#include <thread>
-#include <vector>
+#include <string>
 #include <cstring>
-#include <iostream>
+#include "sample_ring.hpp"
 
+// Records tuisic's own audio into a SampleRing. libmpv has no way to hand
+// out decoded PCM, so instead of the whole sink's monitor this attaches to
+// the one sink input the active mpv handle plays through (our process id
+// and that handle's audio-client-name, see set_target()) and records only
+// that stream, following it when mpv reopens its output, the stream moves
+// to another sink or another handle becomes the active one. Until mpv has ever opened a stream on
+// this server (e.g. it plays through ALSA directly), the default sink's
+// monitor is used as before.
+//
+// Everything runs on PulseAudio's own mainloop thread; the read callback
+// only copies into the ring and notifies, whoever consumes the samples
+// does so on its own thread.
 class AudioCapture {
-private:
-    pa_simple* pulse_connection = nullptr;
-    std::thread capture_thread;
-    std::atomic<bool> should_stop{false};
-    std::function<void(const std::vector<double>&)> callback;
-
+public:
     static constexpr int SAMPLE_RATE = 44100;
     static constexpr int CHANNELS = 2;
-    static constexpr int BUFFER_SIZE = 2048;
+
+private:
+    pa_threaded_mainloop* mainloop = nullptr;
+    pa_context* context = nullptr;
+    pa_stream* stream = nullptr;
+    std::function<void()> on_samples;
+    std::function<void(const std::string&)> on_error;
+    std::string device;
+
+    // Sink input being recorded and the sink it plays on,
+    // PA_INVALID_INDEX while on the default monitor or detached
+    uint32_t monitored_input = PA_INVALID_INDEX;
+    uint32_t monitored_sink = PA_INVALID_INDEX;
+    // Sink input whose sink is being looked up, and that sink
+    uint32_t pending_input = PA_INVALID_INDEX;
+    uint32_t pending_sink = PA_INVALID_INDEX;
+    // application.name of the mpv handle to follow; empty matches any
+    // stream of this process. Mainloop thread, or under its lock.
+    std::string target_client;
+    // Once mpv's stream has been seen, never fall back to the monitor
+    bool found_own_stream = false;
+    // Uncorked; a corked stream keeps its connection but gets no data
+    std::atomic<bool> active{true};
+
+    // Frames per fragment; small fragments keep capture latency near 12 ms
+    static constexpr int FRAGMENT_FRAMES = 512;
+
+    // Half a second of audio
+    SampleRing ring{SAMPLE_RATE * CHANNELS / 2};
 
 public:
     AudioCapture() = default;
@@ -29,120 +63,294 @@ public:
         stop();
     }
 
-    void set_callback(std::function<void(const std::vector<double>&)> cb) {
-        callback = std::move(cb);
+    // Called on the PulseAudio thread after each write to the ring; must
+    // not block. Set before start().
+    void set_notify(std::function<void()> notify) {
+        on_samples = std::move(notify);
     }
 
+    // Receives connection and stream failures, from any thread; the
+    // terminal belongs to the UI, so nothing is printed. Set before start().
+    void set_error_handler(std::function<void(const std::string&)> handler) {
+        on_error = std::move(handler);
+    }
+
+    // Interleaved stereo float samples; read by a single consumer
+    SampleRing& samples() { return ring; }
+
+    // Connects asynchronously; a server that cannot be reached is logged
+    // from the mainloop. With `device_name` that source is recorded as is.
     bool start(const char* device_name = nullptr) {
-        if (pulse_connection) {
+        if (mainloop) {
             return true; // Already started
         }
+        device = device_name ? device_name : "";
 
-        // PulseAudio sample spec
-        pa_sample_spec sample_spec;
-        sample_spec.format = PA_SAMPLE_FLOAT32LE;
-        sample_spec.rate = SAMPLE_RATE;
-        sample_spec.channels = CHANNELS;
+        mainloop = pa_threaded_mainloop_new();
+        if (!mainloop) {
+            report("Failed to create PulseAudio mainloop");
+            return false;
+        }
+        context = pa_context_new(pa_threaded_mainloop_get_api(mainloop), "tuisic");
+        if (!context) {
+            report("Failed to create PulseAudio context");
+            pa_threaded_mainloop_free(mainloop);
+            mainloop = nullptr;
+            return false;
+        }
+        pa_context_set_state_callback(context, &AudioCapture::on_context_state, this);
 
-        // Buffer attributes for low latency
-        pa_buffer_attr buffer_attr;
-        buffer_attr.maxlength = (uint32_t) -1;
-        buffer_attr.tlength = (uint32_t) -1;
-        buffer_attr.prebuf = (uint32_t) -1;
-        buffer_attr.minreq = (uint32_t) -1;
-        buffer_attr.fragsize = BUFFER_SIZE * sizeof(float);
-
-        int error;
-
-        // Use monitor source to capture audio output
-        // @DEFAULT_MONITOR@ is the monitor of the default sink
-        const char* source = device_name ? device_name : "@DEFAULT_MONITOR@";
-
-        std::cout << "[AudioCapture] Connecting to PulseAudio source: " << source << std::endl;
-
-        // Connect to PulseAudio monitor (capture from audio output)
-        pulse_connection = pa_simple_new(
-            nullptr,                          // Use default server
-            "tuisic",                         // Application name
-            PA_STREAM_RECORD,                 // Record stream
-            source,                           // Monitor source
-            "Music Visualization",            // Stream description
-            &sample_spec,                     // Sample format
-            nullptr,                          // Use default channel map
-            &buffer_attr,                     // Buffer attributes
-            &error                            // Error code
-        );
-
-        if (!pulse_connection) {
-            std::cerr << "[AudioCapture] Failed to connect to PulseAudio: " << pa_strerror(error) << std::endl;
-            std::cerr << "[AudioCapture] Make sure PulseAudio is running and you have a default sink" << std::endl;
+        if (pa_context_connect(context, nullptr, PA_CONTEXT_NOFLAGS, nullptr) < 0 ||
+            pa_threaded_mainloop_start(mainloop) < 0) {
+            report(std::string("Failed to connect to PulseAudio: ") +
+                   pa_strerror(pa_context_errno(context)));
+            pa_context_unref(context);
+            context = nullptr;
+            pa_threaded_mainloop_free(mainloop);
+            mainloop = nullptr;
             return false;
         }
+        return true;
+    }
 
-        std::cout << "[AudioCapture] Successfully connected to PulseAudio!" << std::endl;
+    // Follows the sink input of the mpv handle whose audio-client-name is
+    // `client_name`; other handles of this process (a preloading standby)
+    // are ignored. Called again when another handle becomes active.
+    void set_target(const std::string& client_name) {
+        if (!mainloop) {
+            target_client = client_name;
+            return;
+        }
+        pa_threaded_mainloop_lock(mainloop);
+        if (target_client != client_name) {
+            target_client = client_name;
+            pending_input = pending_sink = PA_INVALID_INDEX;
+            if (monitored_input != PA_INVALID_INDEX) {
+                disconnect_stream();
+            }
+            if (device.empty() && pa_context_get_state(context) == PA_CONTEXT_READY) {
+                pa_operation_unref(
+                    pa_context_get_sink_input_info_list(context, &AudioCapture::on_sink_input, this));
+            }
+        }
+        pa_threaded_mainloop_unlock(mainloop);
+    }
 
-        // Start capture thread
-        should_stop = false;
-        capture_thread = std::thread([this]() {
-            this->capture_loop();
-        });
+    // Corks or uncorks recording without tearing anything down, so
+    // resuming is immediate. Also applies to streams connected later.
+    void set_active(bool on) {
+        active = on;
+        if (!mainloop) {
+            return;
+        }
+        pa_threaded_mainloop_lock(mainloop);
+        set_corked(!on);
+        pa_threaded_mainloop_unlock(mainloop);
+    }
 
-        std::cout << "[AudioCapture] Capture thread started" << std::endl;
+    void stop() {
+        if (!mainloop) {
+            return;
+        }
 
-        return true;
+        pa_threaded_mainloop_lock(mainloop);
+        disconnect_stream();
+        pa_context_disconnect(context);
+        pa_context_unref(context);
+        context = nullptr;
+        pa_threaded_mainloop_unlock(mainloop);
+
+        pa_threaded_mainloop_stop(mainloop);
+        pa_threaded_mainloop_free(mainloop);
+        mainloop = nullptr;
+        monitored_input = monitored_sink = pending_input = pending_sink = PA_INVALID_INDEX;
+        found_own_stream = false;
     }
 
-    void stop() {
-        should_stop = true;
+private:
+    // Everything below runs on the mainloop thread
 
-        if (capture_thread.joinable()) {
-            capture_thread.join();
+    static void on_context_state(pa_context* ctx, void* userdata) {
+        auto* self = static_cast<AudioCapture*>(userdata);
+        switch (pa_context_get_state(ctx)) {
+        case PA_CONTEXT_READY:
+            if (!self->device.empty()) {
+                self->connect_stream(self->device.c_str(), PA_INVALID_INDEX, PA_INVALID_INDEX);
+                return;
+            }
+            pa_context_set_subscribe_callback(ctx, &AudioCapture::on_subscribe_event, self);
+            pa_operation_unref(pa_context_subscribe(ctx, PA_SUBSCRIPTION_MASK_SINK_INPUT, nullptr, nullptr));
+            pa_operation_unref(pa_context_get_sink_input_info_list(ctx, &AudioCapture::on_initial_sink_input, self));
+            break;
+        case PA_CONTEXT_FAILED:
+            self->report(std::string("PulseAudio connection failed: ") +
+                         pa_strerror(pa_context_errno(ctx)));
+            break;
+        default:
+            break;
         }
+    }
 
-        if (pulse_connection) {
-            pa_simple_free(pulse_connection);
-            pulse_connection = nullptr;
+    static void on_initial_sink_input(pa_context* ctx, const pa_sink_input_info* info, int eol, void* userdata) {
+        auto* self = static_cast<AudioCapture*>(userdata);
+        if (eol > 0) {
+            // mpv has no stream yet (or does not use this server)
+            if (!self->found_own_stream && !self->stream) {
+                self->connect_stream("@DEFAULT_MONITOR@", PA_INVALID_INDEX, PA_INVALID_INDEX);
+            }
+            return;
         }
+        on_sink_input(ctx, info, eol, userdata);
     }
 
-private:
-    void capture_loop() {
-        std::vector<float> buffer(BUFFER_SIZE * CHANNELS);
-        std::vector<double> double_buffer(BUFFER_SIZE * CHANNELS);
+    static void on_sink_input(pa_context* ctx, const pa_sink_input_info* info, int eol, void* userdata) {
+        auto* self = static_cast<AudioCapture*>(userdata);
+        if (eol != 0 || !info || !self->is_own(info)) {
+            return;
+        }
+        if (info->index == self->monitored_input && info->sink == self->monitored_sink) {
+            return;
+        }
+        self->found_own_stream = true;
+        self->pending_input = info->index;
+        self->pending_sink = info->sink;
+        pa_operation_unref(pa_context_get_sink_info_by_index(ctx, info->sink, &AudioCapture::on_sink, self));
+    }
 
-        int error;
-        int read_count = 0;
+    static void on_sink(pa_context*, const pa_sink_info* info, int eol, void* userdata) {
+        auto* self = static_cast<AudioCapture*>(userdata);
+        // Drop answers that a retarget or a newer lookup overtook
+        if (eol != 0 || !info || self->pending_input == PA_INVALID_INDEX ||
+            info->index != self->pending_sink) {
+            return;
+        }
+        // A sink input is recorded through its sink's monitor source
+        uint32_t input = self->pending_input;
+        self->pending_input = self->pending_sink = PA_INVALID_INDEX;
+        self->connect_stream(std::to_string(info->monitor_source).c_str(), input, info->index);
+    }
 
-        std::cout << "[AudioCapture] Capture loop started, waiting for audio data..." << std::endl;
+    static void on_subscribe_event(pa_context* ctx, pa_subscription_event_type_t type, uint32_t index, void* userdata) {
+        auto* self = static_cast<AudioCapture*>(userdata);
+        if ((type & PA_SUBSCRIPTION_EVENT_FACILITY_MASK) != PA_SUBSCRIPTION_EVENT_SINK_INPUT) {
+            return;
+        }
+        if ((type & PA_SUBSCRIPTION_EVENT_TYPE_MASK) == PA_SUBSCRIPTION_EVENT_REMOVE) {
+            if (index == self->monitored_input) {
+                // mpv closed its output; wait for the next one
+                self->disconnect_stream();
+            }
+            return;
+        }
+        // New stream, or one moved to another sink
+        pa_operation_unref(pa_context_get_sink_input_info(ctx, index, &AudioCapture::on_sink_input, self));
+    }
+
+    static void on_stream_state(pa_stream* s, void* userdata) {
+        auto* self = static_cast<AudioCapture*>(userdata);
+        // A cork requested while connecting did not take; apply it now
+        if (pa_stream_get_state(s) == PA_STREAM_READY && !self->active) {
+            self->set_corked(true);
+        }
+    }
 
-        while (!should_stop) {
-            // Read audio data from PulseAudio
-            if (pa_simple_read(pulse_connection, buffer.data(),
-                              buffer.size() * sizeof(float), &error) < 0) {
-                std::cerr << "[AudioCapture] PulseAudio read error: " << pa_strerror(error) << std::endl;
+    static void on_read(pa_stream* s, size_t, void* userdata) {
+        auto* self = static_cast<AudioCapture*>(userdata);
+        bool wrote = false;
+        const void* data;
+        size_t bytes;
+        while (pa_stream_readable_size(s) > 0) {
+            if (pa_stream_peek(s, &data, &bytes) < 0 || bytes == 0) {
                 break;
             }
-
-            read_count++;
-            if (read_count % 100 == 0) {
-                std::cout << "[AudioCapture] Read " << read_count << " audio buffers" << std::endl;
+            // No data with a size is a hole in the stream; skip it.
+            // Samples stay float until the consumer reads them; a full
+            // ring drops the fragment rather than wait.
+            if (data && self->active) {
+                self->ring.write(static_cast<const float*>(data), bytes / sizeof(float));
+                wrote = true;
             }
+            pa_stream_drop(s);
+        }
+        if (wrote && self->on_samples) {
+            self->on_samples();
+        }
+    }
 
-            // Convert float to double and pass to callback
-            if (callback) {
-                for (size_t i = 0; i < buffer.size(); i++) {
-                    double_buffer[i] = static_cast<double>(buffer[i]);
-                }
-                callback(double_buffer);
-            } else {
-                if (read_count == 1) {
-                    std::cerr << "[AudioCapture] Warning: No callback set!" << std::endl;
-                }
+    void report(const std::string& message) const {
+        if (on_error) {
+            on_error("Visualizer: " + message);
+        }
+    }
+
+    bool is_own(const pa_sink_input_info* info) const {
+        const char* pid = pa_proplist_gets(info->proplist, PA_PROP_APPLICATION_PROCESS_ID);
+        if (!pid || std::to_string(getpid()) != pid) {
+            return false;
+        }
+        const char* name = pa_proplist_gets(info->proplist, PA_PROP_APPLICATION_NAME);
+        return target_client.empty() || (name && target_client == name);
+    }
+
+    void connect_stream(const char* source, uint32_t input, uint32_t sink) {
+        disconnect_stream();
+
+        pa_sample_spec sample_spec;
+        sample_spec.format = PA_SAMPLE_FLOAT32LE;
+        sample_spec.rate = SAMPLE_RATE;
+        sample_spec.channels = CHANNELS;
+
+        stream = pa_stream_new(context, "Music Visualization", &sample_spec, nullptr);
+        if (!stream) {
+            report(std::string("Failed to create capture stream: ") +
+                   pa_strerror(pa_context_errno(context)));
+            return;
+        }
+        if (input != PA_INVALID_INDEX) {
+            pa_stream_set_monitor_stream(stream, input);
+        }
+        pa_stream_set_read_callback(stream, &AudioCapture::on_read, this);
+        pa_stream_set_state_callback(stream, &AudioCapture::on_stream_state, this);
+
+        pa_buffer_attr buffer_attr;
+        buffer_attr.maxlength = (uint32_t) -1;
+        buffer_attr.tlength = (uint32_t) -1;
+        buffer_attr.prebuf = (uint32_t) -1;
+        buffer_attr.minreq = (uint32_t) -1;
+        buffer_attr.fragsize = FRAGMENT_FRAMES * CHANNELS * sizeof(float);
+
+        // A per-stream recording must not be moved off its sink by the
+        // server; on_subscribe_event reattaches when mpv's stream moves
+        auto flags = static_cast<pa_stream_flags_t>(
+            PA_STREAM_ADJUST_LATENCY | (input != PA_INVALID_INDEX ? PA_STREAM_DONT_MOVE : 0) |
+            (active ? 0 : PA_STREAM_START_CORKED));
+        if (pa_stream_connect_record(stream, source, &buffer_attr, flags) < 0) {
+            report(std::string("Failed to record from ") + source + ": " +
+                   pa_strerror(pa_context_errno(context)));
+            disconnect_stream();
+            return;
+        }
+        monitored_input = input;
+        monitored_sink = sink;
+    }
+
+    void set_corked(bool corked) {
+        if (stream && pa_stream_get_state(stream) == PA_STREAM_READY) {
+            pa_operation* op = pa_stream_cork(stream, corked ? 1 : 0, nullptr, nullptr);
+            if (op) {
+                pa_operation_unref(op);
             }
         }
+    }
 
-        std::cout << "[AudioCapture] Capture loop stopped" << std::endl;
+    void disconnect_stream() {
+        if (stream) {
+            pa_stream_disconnect(stream);
+            pa_stream_unref(stream);
+            stream = nullptr;
+        }
+        monitored_input = monitored_sink = PA_INVALID_INDEX;
     }
 };
 
-#endif // WITH_CAVA
+#endif // WITH_VISUALIZER
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+// CAVA-style bar motion in real time rather than per frame: bars rise
+// toward a louder target quickly and fall under gravity, accelerating the
+// longer they fall. The same audio looks the same at any frame rate.
+// Levels are 0..1.
+class BarSmoother {
+private:
+  // Time constant of the rise toward a louder target
+  static constexpr double RISE_TAU = 0.04; // s
+  // Fall acceleration, levels per second squared
+  static constexpr double GRAVITY = 6.0;
+  // Below this a bar counts as empty
+  static constexpr double REST = 1e-3;
+
+  std::vector<double> levels;
+  std::vector<double> fall_speed;
+
+public:
+  explicit BarSmoother(size_t bars) : levels(bars, 0.0), fall_speed(bars, 0.0) {}
+
+  size_t size() const { return levels.size(); }
+
+  // Advances every bar `dt` seconds toward `targets` (one per bar) and
+  // returns the levels, valid until the next call
+  const std::vector<double> &update(const std::vector<double> &targets, double dt) {
+    double rise = 1.0 - std::exp(-dt / RISE_TAU);
+    for (size_t i = 0; i < levels.size(); i++) {
+      double target = i < targets.size() ? targets[i] : 0.0;
+      if (target >= levels[i]) {
+        levels[i] += (target - levels[i]) * rise;
+        fall_speed[i] = 0.0;
+      } else {
+        fall_speed[i] += GRAVITY * dt;
+        levels[i] = std::max(target, levels[i] - fall_speed[i] * dt);
+      }
+    }
+    return levels;
+  }
+
+  // True once every bar has fallen to nothing
+  bool at_rest() const {
+    return std::all_of(levels.begin(), levels.end(), [](double l) { return l < REST; });
+  }
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Picks the stream quality for page URLs resolved by mpv's yt-dlp hook
+// (Saavn offers 96/160/320 kbps, SoundCloud a few transcodings between 64
+// and 160). Starts at the user's ceiling, drops a tier after a stall and
+// climbs back once the buffer has stayed healthy on a link with room for
+// the next tier. The choice applies from the next track loaded: yt-dlp
+// resolves a single format per load.
+class BitrateSelector {
+private:
+  static constexpr int TIERS[] = {96, 160, 320}; // kbps
+  static constexpr int TIER_COUNT = sizeof(TIERS) / sizeof(TIERS[0]);
+  // Stall-free playing time before trying the next tier up
+  static constexpr double STEP_UP_SECS = 120.0;
+  // Link speed, as a multiple of the next tier's bitrate, needed to step up
+  static constexpr double HEADROOM = 3.0;
+
+  int ceiling; // highest tier index allowed by config
+  std::atomic<int> tier;
+  double healthy_for = 0.0; // event thread only
+
+public:
+  explicit BitrateSelector(int max_kbps = 320) { set_ceiling(max_kbps); }
+
+  // Highest tier not above max_kbps; always allows the lowest tier
+  void set_ceiling(int max_kbps) {
+    int index = 0;
+    while (index + 1 < TIER_COUNT && TIERS[index + 1] <= max_kbps) {
+      index++;
+    }
+    ceiling = index;
+    tier = index;
+  }
+
+  int current_kbps() const { return TIERS[tier]; }
+
+  // Playback stalled on a network stream
+  void on_stall() {
+    healthy_for = 0.0;
+    int current = tier;
+    if (current > 0) {
+      tier = current - 1;
+    }
+  }
+
+  // Periodic sample while a network stream plays without stalling;
+  // throughput in bytes/s
+  void on_sample(int64_t throughput, double elapsed_secs) {
+    healthy_for += elapsed_secs;
+    int current = tier;
+    if (current >= ceiling || healthy_for < STEP_UP_SECS) {
+      return;
+    }
+    int64_t next_rate = static_cast<int64_t>(TIERS[current + 1]) * 1000 / 8;
+    if (throughput >= next_rate * HEADROOM) {
+      tier = current + 1;
+      healthy_for = 0.0;
+    }
+  }
+
+  // yt-dlp format selector for the current tier. Formats without a known
+  // bitrate pass the filter; anything else falls back to the best audio.
+  std::string ytdl_format() const {
+    return "bestaudio[abr<=?" + std::to_string(current_kbps()) + "]/bestaudio/best";
+  }
+};
@@ -115,48 +115,21 @@ public:
 class TUIDiscordIntegration {
 private:
   std::unique_ptr<DiscordRPCHandler> discord_handler;
-  std::vector<Track> &track_data;
-  std::vector<Track> &next_tracks;
-  int &current_track_index;
   std::shared_ptr<MusicPlayer> player;
 
 public:
-  TUIDiscordIntegration(
-      std::vector<Track> &tracks,
-      std::vector<Track> &next_track_list,
-      int &track_index,
-      std::shared_ptr<MusicPlayer> player_instance)
-      : track_data(tracks),
-        next_tracks(next_track_list),
-        current_track_index(track_index),
-        player(player_instance) {}
+  explicit TUIDiscordIntegration(std::shared_ptr<MusicPlayer> player_instance)
+      : player(player_instance) {}
 
   void setup(const std::string& client_id) {
     discord_handler = std::make_unique<DiscordRPCHandler>(client_id);
     discord_handler->initialize();
 
+    // Current track comes from the player's snapshot
     discord_handler->setTrackCallbacks(
-        [this]() -> std::string {
-          // Use next_tracks if available, otherwise fall back to track_data
-          auto &source = !next_tracks.empty() ? next_tracks : track_data;
-          return (source.empty() || current_track_index >= source.size())
-                     ? ""
-                     : source[current_track_index].name;
-        },
-        [this]() -> std::string {
-          // Use next_tracks if available, otherwise fall back to track_data
-          auto &source = !next_tracks.empty() ? next_tracks : track_data;
-          return (source.empty() || current_track_index >= source.size())
-                     ? ""
-                     : source[current_track_index].artist;
-        },
-        [this]() -> std::string {
-          // Use next_tracks if available, otherwise fall back to track_data
-          auto &source = !next_tracks.empty() ? next_tracks : track_data;
-          return (source.empty() || current_track_index >= source.size())
-                     ? ""
-                     : source[current_track_index].coverImage;
-        },
+        [this]() -> std::string { return player->snapshot()->track.name; },
+        [this]() -> std::string { return player->snapshot()->track.artist; },
+        [this]() -> std::string { return player->snapshot()->track.coverImage; },
         [this]() -> bool {
           return player && player->is_playing_state();
         });
@@ -170,7 +170,7 @@ private:
                                             sdbus::Signature{""},
                                             {},
                                             [this](sdbus::MethodCall call) {
-                                              // player->previous_track();
+                                              player->previous_track();
                                               if (on_previous_track)
                                                 on_previous_track();
                                               updateMetadata();
@@ -307,53 +307,21 @@ private:
 class TUIMPRISIntegration {
 private:
   std::unique_ptr<MPRISHandler> mpris_handler;
-  std::vector<Track> &track_data; // Your TUI track data
-  std::vector<Track> &next_tracks; // The actual playing playlist
-  int &current_track_index;
 
 public:
-  TUIMPRISIntegration(std::vector<Track> &tracks, std::vector<Track> &next_track_list, int &track_index)
-      : track_data(tracks), next_tracks(next_track_list), current_track_index(track_index) {}
-
   void setup(std::shared_ptr<MusicPlayer> player) {
     mpris_handler = std::make_unique<MPRISHandler>(player);
     mpris_handler->initialize();
 
+    // The player owns the queue and publishes the current track in its
+    // snapshot; skips already went through player->next_track() and
+    // player->previous_track().
     mpris_handler->setTrackCallbacks(
-        [this]() -> std::string {
-          // Use next_tracks if available, otherwise fall back to track_data
-          auto &source = !next_tracks.empty() ? next_tracks : track_data;
-          return (source.empty() || current_track_index >= source.size())
-                     ? ""
-                     : source[current_track_index].id;
-        },
-        [this]() -> std::string {
-          // Use next_tracks if available, otherwise fall back to track_data
-          auto &source = !next_tracks.empty() ? next_tracks : track_data;
-          return (source.empty() || current_track_index >= source.size())
-                     ? ""
-                     : source[current_track_index].name;
-        },
-        [this]() -> std::string {
-          // Use next_tracks if available, otherwise fall back to track_data
-          auto &source = !next_tracks.empty() ? next_tracks : track_data;
-          return (source.empty() || current_track_index >= source.size())
-                     ? ""
-                     : source[current_track_index].artist;
-        },
-        [this]() {
-          // Next track via MPRIS
-          auto &source = !next_tracks.empty() ? next_tracks : track_data;
-          if (current_track_index < source.size() - 1) {
-            current_track_index++;
-          }
-        },
-        [this]() {
-          // Previous track via MPRIS
-          if (current_track_index > 0) {
-            current_track_index--;
-          }
-        });
+        [player]() -> std::string { return player->snapshot()->track.id; },
+        [player]() -> std::string { return player->snapshot()->track.name; },
+        [player]() -> std::string { return player->snapshot()->track.artist; },
+        []() {},
+        []() {});
 
     mpris_handler->startEventLoop();
   }
@@ -0,0 +1,347 @@
+#pragma once
+
+#include "../common/Track.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <vector>
+
+// Tracks are shared between the queue, history and observers by handle,
+// so reordering and notifications never copy Track contents.
+using TrackHandle = std::shared_ptr<const Track>;
+
+// A single edit to the queue, delivered to observers
+struct QueueChange {
+  enum class Kind {
+    Inserted,       // track inserted at index
+    Removed,        // track removed from index
+    Moved,          // track moved from index to `to`
+    Cleared,        // queue emptied
+    Reordered,      // shuffle or unshuffle; re-read the order if needed
+    CurrentChanged, // current entry is now index (track may be null)
+  };
+
+  Kind kind;
+  size_t index = 0;
+  size_t to = 0;
+  TrackHandle track;
+};
+
+// The play queue owned by MusicPlayer: an ordered list of track handles,
+// a current position, shuffle with undo, and a bounded play history.
+// Thread-safe; observers run after the queue lock is released.
+class PlayQueue {
+public:
+  using Observer = std::function<void(const QueueChange &)>;
+
+private:
+  mutable std::mutex queue_mutex;
+  std::vector<TrackHandle> items;
+  int current = -1;
+
+  // Order before shuffle(); empty when not shuffled
+  std::vector<TrackHandle> unshuffled;
+
+  // Previously played tracks, most recent last
+  std::deque<TrackHandle> history;
+  static constexpr size_t HISTORY_LIMIT = 100;
+
+  std::mutex observer_mutex;
+  std::vector<std::pair<int, Observer>> observers;
+  int next_observer_id = 0;
+
+public:
+  int subscribe(Observer observer) {
+    std::lock_guard<std::mutex> lock(observer_mutex);
+    observers.emplace_back(next_observer_id, std::move(observer));
+    return next_observer_id++;
+  }
+
+  void unsubscribe(int id) {
+    std::lock_guard<std::mutex> lock(observer_mutex);
+    observers.erase(std::remove_if(observers.begin(), observers.end(),
+                                   [id](const auto &o) { return o.first == id; }),
+                    observers.end());
+  }
+
+  // Replace the contents and make `start` the current entry
+  void assign(const std::vector<Track> &tracks, int start = 0) {
+    std::vector<QueueChange> changes{{QueueChange::Kind::Cleared}};
+    {
+      std::lock_guard<std::mutex> lock(queue_mutex);
+      // What was playing goes to history before its list is gone
+      if (current >= 0) {
+        remember(items[current]);
+      }
+      items.clear();
+      unshuffled.clear();
+      current = -1;
+      items.reserve(tracks.size());
+      for (const auto &track : tracks) {
+        items.push_back(std::make_shared<const Track>(track));
+        changes.push_back({QueueChange::Kind::Inserted, items.size() - 1, 0,
+                           items.back()});
+      }
+      changes.push_back(set_current(items.empty() ? -1 : std::clamp(start, 0, static_cast<int>(items.size()) - 1)));
+    }
+    notify(changes);
+  }
+
+  void clear() {
+    {
+      std::lock_guard<std::mutex> lock(queue_mutex);
+      items.clear();
+      unshuffled.clear();
+      current = -1;
+    }
+    notify({{QueueChange::Kind::Cleared}});
+  }
+
+  size_t size() const {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    return items.size();
+  }
+
+  bool empty() const {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    return items.empty();
+  }
+
+  TrackHandle at(size_t index) const {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    return index < items.size() ? items[index] : nullptr;
+  }
+
+  TrackHandle current_track() const {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    return current >= 0 ? items[current] : nullptr;
+  }
+
+  int current_index() const {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    return current;
+  }
+
+  // Entry that advance() would move to, without moving
+  TrackHandle peek_next() const {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    if (items.empty()) {
+      return nullptr;
+    }
+    return items[(current + 1) % items.size()];
+  }
+
+  // Handles only; the tracks themselves are shared, not copied
+  std::vector<TrackHandle> tracks() const {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    return items;
+  }
+
+  std::vector<TrackHandle> get_history() const {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    return {history.begin(), history.end()};
+  }
+
+  void insert(size_t index, const Track &track) {
+    QueueChange change{QueueChange::Kind::Inserted};
+    {
+      std::lock_guard<std::mutex> lock(queue_mutex);
+      index = std::min(index, items.size());
+      change.index = index;
+      change.track = std::make_shared<const Track>(track);
+      items.insert(items.begin() + index, change.track);
+      if (!unshuffled.empty()) {
+        unshuffled.push_back(change.track);
+      }
+      if (current >= static_cast<int>(index)) {
+        current++;
+      }
+    }
+    notify({change});
+  }
+
+  void append(const Track &track) { insert(SIZE_MAX, track); }
+
+  // Queue a track right after the current one
+  void play_next(const Track &track) {
+    insert(static_cast<size_t>(current_index() + 1), track);
+  }
+
+  void remove(size_t index) {
+    std::vector<QueueChange> changes;
+    {
+      std::lock_guard<std::mutex> lock(queue_mutex);
+      if (index >= items.size()) {
+        return;
+      }
+      TrackHandle removed = items[index];
+      items.erase(items.begin() + index);
+      unshuffled.erase(std::remove(unshuffled.begin(), unshuffled.end(), removed),
+                       unshuffled.end());
+      changes.push_back({QueueChange::Kind::Removed, index, 0, removed});
+
+      if (current > static_cast<int>(index)) {
+        current--;
+      } else if (current == static_cast<int>(index)) {
+        // The entry that slid into this slot becomes current
+        int next = items.empty() ? -1 : std::min(current, static_cast<int>(items.size()) - 1);
+        current = -1;
+        changes.push_back(set_current(next));
+      }
+    }
+    notify(changes);
+  }
+
+  void move(size_t from, size_t to) {
+    QueueChange change{QueueChange::Kind::Moved, from, to};
+    {
+      std::lock_guard<std::mutex> lock(queue_mutex);
+      if (from >= items.size() || to >= items.size() || from == to) {
+        return;
+      }
+      change.track = items[from];
+      if (from < to) {
+        std::rotate(items.begin() + from, items.begin() + from + 1, items.begin() + to + 1);
+      } else {
+        std::rotate(items.begin() + to, items.begin() + from, items.begin() + from + 1);
+      }
+
+      int cur = current;
+      if (cur == static_cast<int>(from)) {
+        current = static_cast<int>(to);
+      } else if (from < to && cur > static_cast<int>(from) && cur <= static_cast<int>(to)) {
+        current--;
+      } else if (to < from && cur >= static_cast<int>(to) && cur < static_cast<int>(from)) {
+        current++;
+      }
+    }
+    notify({change});
+  }
+
+  // Step to the next entry, wrapping around; returns the new current track
+  TrackHandle advance() {
+    std::vector<QueueChange> changes;
+    TrackHandle track;
+    {
+      std::lock_guard<std::mutex> lock(queue_mutex);
+      if (items.empty()) {
+        return nullptr;
+      }
+      changes.push_back(set_current((current + 1) % static_cast<int>(items.size())));
+      track = items[current];
+    }
+    notify(changes);
+    return track;
+  }
+
+  // Step to the previous entry, wrapping around
+  TrackHandle retreat() {
+    std::vector<QueueChange> changes;
+    TrackHandle track;
+    {
+      std::lock_guard<std::mutex> lock(queue_mutex);
+      if (items.empty()) {
+        return nullptr;
+      }
+      int size = static_cast<int>(items.size());
+      changes.push_back(set_current((std::max(current, 0) - 1 + size) % size));
+      track = items[current];
+    }
+    notify(changes);
+    return track;
+  }
+
+  TrackHandle jump(size_t index) {
+    std::vector<QueueChange> changes;
+    TrackHandle track;
+    {
+      std::lock_guard<std::mutex> lock(queue_mutex);
+      if (index >= items.size()) {
+        return nullptr;
+      }
+      changes.push_back(set_current(static_cast<int>(index)));
+      track = items[current];
+    }
+    notify(changes);
+    return track;
+  }
+
+  // Shuffle everything after the current entry. unshuffle() restores the
+  // original order and keeps the current track current.
+  void shuffle() {
+    {
+      std::lock_guard<std::mutex> lock(queue_mutex);
+      if (items.size() < 2) {
+        return;
+      }
+      if (unshuffled.empty()) {
+        unshuffled = items;
+      }
+      std::random_device rd;
+      std::mt19937 g(rd());
+      std::shuffle(items.begin() + (current + 1), items.end(), g);
+    }
+    notify({{QueueChange::Kind::Reordered}});
+  }
+
+  bool unshuffle() {
+    {
+      std::lock_guard<std::mutex> lock(queue_mutex);
+      if (unshuffled.empty()) {
+        return false;
+      }
+      TrackHandle playing = current >= 0 ? items[current] : nullptr;
+      items = std::move(unshuffled);
+      unshuffled.clear();
+      if (playing) {
+        current = static_cast<int>(std::find(items.begin(), items.end(), playing) - items.begin());
+      }
+    }
+    notify({{QueueChange::Kind::Reordered}});
+    return true;
+  }
+
+  bool is_shuffled() const {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    return !unshuffled.empty();
+  }
+
+private:
+  // Caller holds queue_mutex
+  void remember(const TrackHandle &track) {
+    history.push_back(track);
+    if (history.size() > HISTORY_LIMIT) {
+      history.pop_front();
+    }
+  }
+
+  // Caller holds queue_mutex
+  QueueChange set_current(int index) {
+    if (current >= 0 && current != index) {
+      remember(items[current]);
+    }
+    current = index;
+    return {QueueChange::Kind::CurrentChanged, static_cast<size_t>(std::max(index, 0)), 0,
+            index >= 0 ? items[index] : nullptr};
+  }
+
+  void notify(const std::vector<QueueChange> &changes) {
+    std::vector<Observer> targets;
+    {
+      std::lock_guard<std::mutex> lock(observer_mutex);
+      for (const auto &o : observers) {
+        targets.push_back(o.second);
+      }
+    }
+    for (const auto &change : changes) {
+      for (const auto &observer : targets) {
+        observer(change);
+      }
+    }
+  }
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "playback_state.hpp"
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// A change in playback worth pushing to followers (MCP subscriptions,
+// the control socket), carrying the snapshot published with it
+struct PlaybackEvent {
+  enum class Kind {
+    TrackChanged, // a new file finished loading
+    Paused,
+    Resumed,
+    Lyric,      // current lyric or subtitle line changed (`text`)
+    QueueEnded, // the last queue entry played to its end
+    Position,   // about once a second while playing, and on seeks
+  };
+
+  Kind kind;
+  std::shared_ptr<const PlaybackSnapshot> snapshot;
+  std::string text;
+
+  static const char *name(Kind kind) {
+    switch (kind) {
+    case Kind::TrackChanged:
+      return "track_changed";
+    case Kind::Paused:
+      return "paused";
+    case Kind::Resumed:
+      return "resumed";
+    case Kind::Lyric:
+      return "lyric";
+    case Kind::QueueEnded:
+      return "queue_ended";
+    case Kind::Position:
+      return "position";
+    }
+    return "";
+  }
+};
+
+// Any number of listeners for PlaybackEvent. The player publishes from its
+// event thread, sometimes holding its own lock, so listeners must only
+// hand events off (queue them) and never call back into the player.
+class PlaybackEvents {
+public:
+  using Listener = std::function<void(const PlaybackEvent &)>;
+
+private:
+  std::mutex listener_mutex;
+  std::vector<std::pair<int, Listener>> listeners;
+  int next_listener_id = 0;
+
+public:
+  int subscribe(Listener listener) {
+    std::lock_guard<std::mutex> lock(listener_mutex);
+    listeners.emplace_back(next_listener_id, std::move(listener));
+    return next_listener_id++;
+  }
+
+  void unsubscribe(int id) {
+    std::lock_guard<std::mutex> lock(listener_mutex);
+    listeners.erase(std::remove_if(listeners.begin(), listeners.end(),
+                                   [id](const auto &l) { return l.first == id; }),
+                    listeners.end());
+  }
+
+  void publish(const PlaybackEvent &event) {
+    std::vector<Listener> targets;
+    {
+      std::lock_guard<std::mutex> lock(listener_mutex);
+      if (listeners.empty()) {
+        return;
+      }
+      for (const auto &l : listeners) {
+        targets.push_back(l.second);
+      }
+    }
+    for (const auto &listener : targets) {
+      listener(event);
+    }
+  }
+};
@@ -0,0 +1,167 @@
+#pragma once
+
+#include "../common/Track.h"
+#include "lyrics_fetcher.hpp"
+#include <cerrno>
+#include <map>
+#include <optional>
+#include <rapidjson/document.h>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// Everything another process needs to carry on playing where this one
+// stopped: the queue and current entry, the playhead, stream URLs mpv
+// already resolved (so yt-dlp does not run again) and the lyrics of the
+// current track. Passed to the detached daemon over a pipe as JSON.
+struct PlaybackSession {
+  std::vector<Track> queue;
+  int index = 0;
+  double position = 0.0;
+  bool paused = false;
+  int volume = 100;
+  // Track url -> media URL mpv opened for it
+  std::map<std::string, std::string> streams;
+  std::vector<tuisic::LyricLine> lyrics;
+
+  std::string serialize() const {
+    rapidjson::Document doc;
+    doc.SetObject();
+    auto &allocator = doc.GetAllocator();
+
+    rapidjson::Value tracks(rapidjson::kArrayType);
+    for (const auto &track : queue) {
+      rapidjson::Value item(rapidjson::kObjectType);
+      item.AddMember("name", rapidjson::StringRef(track.name.c_str()), allocator);
+      item.AddMember("artist", rapidjson::StringRef(track.artist.c_str()), allocator);
+      item.AddMember("url", rapidjson::StringRef(track.url.c_str()), allocator);
+      item.AddMember("id", rapidjson::StringRef(track.id.c_str()), allocator);
+      item.AddMember("source", rapidjson::StringRef(track.source.c_str()), allocator);
+      item.AddMember("coverImage", rapidjson::StringRef(track.coverImage.c_str()), allocator);
+      item.AddMember("language", rapidjson::StringRef(track.language.c_str()), allocator);
+      tracks.PushBack(item, allocator);
+    }
+    doc.AddMember("queue", tracks, allocator);
+    doc.AddMember("index", index, allocator);
+    doc.AddMember("position", position, allocator);
+    doc.AddMember("paused", paused, allocator);
+    doc.AddMember("volume", volume, allocator);
+
+    rapidjson::Value stream_map(rapidjson::kObjectType);
+    for (const auto &[url, stream] : streams) {
+      stream_map.AddMember(rapidjson::StringRef(url.c_str()),
+                           rapidjson::StringRef(stream.c_str()), allocator);
+    }
+    doc.AddMember("streams", stream_map, allocator);
+
+    rapidjson::Value lines(rapidjson::kArrayType);
+    for (const auto &line : lyrics) {
+      rapidjson::Value item(rapidjson::kObjectType);
+      item.AddMember("time", line.timestamp, allocator);
+      item.AddMember("text", rapidjson::StringRef(line.text.c_str()), allocator);
+      lines.PushBack(item, allocator);
+    }
+    doc.AddMember("lyrics", lines, allocator);
+
+    rapidjson::StringBuffer buffer;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+    doc.Accept(writer);
+    return buffer.GetString();
+  }
+
+  static std::optional<PlaybackSession> parse(const std::string &json) {
+    rapidjson::Document doc;
+    doc.Parse(json.c_str());
+    if (doc.HasParseError() || !doc.IsObject() || !doc.HasMember("queue") ||
+        !doc["queue"].IsArray()) {
+      return std::nullopt;
+    }
+
+    auto get = [](const rapidjson::Value &item, const char *key) -> std::string {
+      return item.HasMember(key) && item[key].IsString() ? item[key].GetString() : "";
+    };
+    PlaybackSession session;
+    for (const auto &item : doc["queue"].GetArray()) {
+      if (!item.IsObject()) {
+        continue;
+      }
+      Track track;
+      track.name = get(item, "name");
+      track.artist = get(item, "artist");
+      track.url = get(item, "url");
+      track.id = get(item, "id");
+      track.source = get(item, "source");
+      track.coverImage = get(item, "coverImage");
+      track.language = get(item, "language");
+      session.queue.push_back(track);
+    }
+    if (doc.HasMember("index") && doc["index"].IsInt()) {
+      session.index = doc["index"].GetInt();
+    }
+    if (doc.HasMember("position") && doc["position"].IsNumber()) {
+      session.position = doc["position"].GetDouble();
+    }
+    if (doc.HasMember("paused") && doc["paused"].IsBool()) {
+      session.paused = doc["paused"].GetBool();
+    }
+    if (doc.HasMember("volume") && doc["volume"].IsInt()) {
+      session.volume = doc["volume"].GetInt();
+    }
+    if (doc.HasMember("streams") && doc["streams"].IsObject()) {
+      for (const auto &entry : doc["streams"].GetObject()) {
+        if (entry.value.IsString()) {
+          session.streams[entry.name.GetString()] = entry.value.GetString();
+        }
+      }
+    }
+    if (doc.HasMember("lyrics") && doc["lyrics"].IsArray()) {
+      for (const auto &item : doc["lyrics"].GetArray()) {
+        if (item.IsObject() && item.HasMember("time") && item["time"].IsNumber()) {
+          session.lyrics.emplace_back(item["time"].GetDouble(), get(item, "text"));
+        }
+      }
+    }
+    if (session.queue.empty() || session.index < 0 ||
+        session.index >= static_cast<int>(session.queue.size())) {
+      return std::nullopt;
+    }
+    return session;
+  }
+
+  // Writes the session and closes `fd`. The reader sees EOF at its end.
+  bool write_to(int fd) const {
+    std::string data = serialize();
+    size_t done = 0;
+    while (done < data.size()) {
+      ssize_t n = write(fd, data.data() + done, data.size() - done);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        break;
+      }
+      done += n;
+    }
+    close(fd);
+    return done == data.size();
+  }
+
+  // Reads a session up to EOF on `fd`
+  static std::optional<PlaybackSession> read_from(int fd) {
+    std::string data;
+    char buf[4096];
+    for (;;) {
+      ssize_t n = read(fd, buf, sizeof(buf));
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        break;
+      }
+      data.append(buf, n);
+    }
+    return parse(data);
+  }
+};
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "../common/Track.h"
+#include "readahead_controller.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Work done by the visualizer thread and how long it was suspended
+struct VisualizerStats {
+  uint64_t frames = 0;      // bar frames published
+  uint64_t spectra = 0;     // spectrum passes over new audio
+  uint64_t suspensions = 0; // times capture was corked
+  double active_secs = 0.0;
+  double suspended_secs = 0.0;
+  bool suspended = true;
+  int64_t stamp = 0; // steady clock (ns) the totals above run to
+
+  // Totals including the stretch since the last update
+  double active_total(int64_t now) const {
+    return active_secs + (!suspended && stamp > 0 ? (now - stamp) / 1e9 : 0.0);
+  }
+  double suspended_total(int64_t now) const {
+    return suspended_secs + (suspended && stamp > 0 ? (now - stamp) / 1e9 : 0.0);
+  }
+};
+
+// Immutable view of everything the UI, MPRIS and the command handler read
+// from the player. A new snapshot is published on every change; readers
+// grab the current one and never contend with the mpv event thread or the
+// audio capture thread.
+struct PlaybackSnapshot {
+  // Position as last reported by mpv, and when (steady clock, ns)
+  double position = 0.0;
+  int64_t position_stamp = 0;
+  double duration = 0.0;
+  int volume = 100;
+
+  bool loaded = false;
+  bool paused = false;
+  bool buffering = false;
+
+  // Seconds of audio demuxed ahead of the playhead (-1 = unknown), and
+  // whether it arrives over the network
+  double cache_duration = -1.0;
+  bool streaming = false;
+  // Stalls, link speed and buffer target for network streams
+  ReadaheadController::Stats stream_stats;
+  // Bitrate ceiling requested for the current stream, 0 for local files
+  int quality_kbps = 0;
+
+  Track track;
+  std::string subtitle; // current lyric line or mpv subtitle
+  std::shared_ptr<const std::vector<double>> viz_frame;
+  VisualizerStats viz_stats;
+
+  static int64_t clock_now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  bool playing() const { return loaded && !paused; }
+
+  // Reported position advanced locally while the clock is running
+  double interpolated_position(int64_t now = clock_now()) const {
+    double pos = position;
+    if (loaded && !paused && !buffering && position_stamp > 0) {
+      pos += (now - position_stamp) / 1e9;
+      if (duration > 0) {
+        pos = std::min(pos, duration);
+      }
+    }
+    return pos;
+  }
+};
+
+// Copy-on-write publisher for PlaybackSnapshot. Writers serialize among
+// themselves and swap in a new snapshot atomically; load() only copies a
+// shared_ptr.
+class PlaybackState {
+private:
+  std::shared_ptr<const PlaybackSnapshot> current =
+      std::make_shared<const PlaybackSnapshot>();
+  std::mutex writer_mutex;
+
+public:
+  std::shared_ptr<const PlaybackSnapshot> load() const {
+    return std::atomic_load(&current);
+  }
+
+  // Apply fn to a copy of the current snapshot and publish the result
+  template <typename Fn> void update(Fn &&fn) {
+    std::lock_guard<std::mutex> lock(writer_mutex);
+    auto next = std::make_shared<PlaybackSnapshot>(*std::atomic_load(&current));
+    fn(*next);
+    std::atomic_store(&current,
+                      std::shared_ptr<const PlaybackSnapshot>(std::move(next)));
+  }
+};
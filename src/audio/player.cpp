@@ -3,23 +3,36 @@
 #include "../common/Track.h"
 #include "../core/config/config.hpp"
 #include "../common/notification.hpp"
+#include "../common/paths.hpp"
 #include "lyrics_fetcher.hpp"
-#ifdef WITH_CAVA
+#include "playback_state.hpp"
+#include "playback_session.hpp"
+#include "playback_events.hpp"
+#include "play_queue.hpp"
+#include "readahead_controller.hpp"
+#include "bitrate_selector.hpp"
+#include "../storage/audio_cache.hpp"
+#include "../storage/local_library.hpp"
+#ifdef WITH_VISUALIZER
 #include "visualizer.hpp"
 #include "audio_capture.hpp"
+#include "visualizer_step.hpp"
 #endif
 #include <algorithm>
 #include <atomic>
 #include <cmath>
+#include <condition_variable>
 #include <cstdlib>
 #include <cstring>
 #include <curl/curl.h>
+#include <filesystem>
 #include <fmt/format.h>
 #include <functional>
 #include <iostream>
 #include <memory>
 #include <mpv/client.h>
 #include <mutex>
+#include <optional>
 #include <random>
 #include <thread>
 
@@ -27,19 +40,51 @@
 #define M_PI 3.14159265358979323846
 #endif
 
+// A track the user asked to keep while it played ("d" on the playing
+// track). `file` holds what was recorded: the whole track when `complete`,
+// otherwise its beginning; empty when nothing usable was recorded.
+// `stream` is what mpv opened for the track, after yt-dlp, from which
+// the rest of an incomplete recording can be fetched.
+struct KeptTrack {
+  Track track;
+  std::string output; // download destination, extension from `format`
+  std::string format;
+  std::string file;
+  bool complete = false;
+  std::string stream;
+};
+
 class MusicPlayer {
 private:
-#ifdef WITH_CAVA
-  std::shared_ptr<AudioVisualizer> visualizer;
+#ifdef WITH_VISUALIZER
+  // Owned by the visualizer thread, rebuilt when the bar count changes
+  std::unique_ptr<AudioVisualizer> visualizer;
   std::shared_ptr<AudioCapture> audio_capture;
+  // Drains the capture ring into the visualizer, off the capture thread
+  std::thread viz_thread;
+  std::mutex viz_mutex;
+  std::condition_variable viz_wake;
+  // Frames per second of the visualizer thread (ui.visualizer_fps)
+  std::atomic<int> viz_fps{30};
+  // Bars the frame should have (ui.visualizer_bars, or the UI's width)
+  std::atomic<int> viz_bars{16};
+  // Capture and spectrum run only while mpv produces audio (core-idle
+  // unset) and the bars panel was drawn lately; otherwise the stream is
+  // corked and the thread sleeps. Daemon mode never draws, so never starts.
+  std::atomic<bool> audio_idle{true};
+  std::atomic<int64_t> viz_drawn_stamp{0};
+  std::atomic<bool> viz_kick{false};
+  static constexpr int64_t VIZ_HIDDEN_AFTER_NS = 2000000000LL;
 #endif
-  std::vector<double> audio_buffer;
   std::function<void(const std::vector<double> &)> on_audio_data;
-  std::vector<double> visualization_data;  // Store processed visualization data
-
 
   // Smart pointer with custom deleter for mpv handle
   std::unique_ptr<mpv_handle, decltype(&mpv_destroy)> mpv{nullptr, mpv_destroy};
+  // The handle in `mpv`, for the event thread. Both change together under
+  // player_mutex when the standby is promoted.
+  std::atomic<mpv_handle *> active_mpv{nullptr};
+  // Numbers each instance's audio-client-name
+  int handle_serial = 0;
   std::shared_ptr<Config> config;
 
   // Thread management with unique_ptr
@@ -47,30 +92,35 @@ private:
 
   // Atomic flags for thread-safe state management
   std::atomic_bool running{true};
-  std::atomic_bool is_playing{false};
-  std::atomic_bool is_paused{false};
-  std::atomic_bool is_loaded{false};
 
-  // Atomic properties with thread-safe access
-  std::atomic<double> current_position{0.0};
-  std::atomic<double> duration{0.0};
-  std::atomic_bool is_downloading{false};
+  // Playback state published for readers (UI, MPRIS, command handler).
+  // Getters read the current snapshot and never take player_mutex.
+  PlaybackState state;
+
+  // Last position pushed to on_time_update (event thread only)
+  double notified_position = 0.0;
+  int64_t notified_stamp = 0;
 
-  // Mutex for thread-safe operations
+  // Network buffer sizing (event thread only)
+  ReadaheadController readahead;
+  int64_t last_speed_sample = 0;
+
+  // Quality requested from yt-dlp for page URLs; stepped by the event
+  // thread, read when loading a file
+  BitrateSelector bitrate;
+
+  // Serializes mpv commands and playlist changes
   mutable std::mutex player_mutex;
 
-  // Playlist management
-  std::vector<std::string> playlist;
-  std::atomic<int> current_playlist_index{-1};
+  // Play queue; advanced by the player on end of file
+  PlayQueue play_queue;
 
-  // Subtitle management - changed to avoid atomic<shared_ptr>
-  std::string current_subtitle{""};
   std::atomic_bool subtitles_enabled{true}; // Toggle for showing/hiding subtitles
 
-  // Lyrics management
+  // Lyrics management. Parsed lines are swapped in whole (atomic_load /
+  // atomic_store) so the event thread syncs them without a lock.
   std::unique_ptr<tuisic::LyricsFetcher> lyrics_fetcher;
-  std::vector<tuisic::LyricLine> current_lyrics;
-  std::atomic_bool has_lyrics{false};
+  std::shared_ptr<const std::vector<tuisic::LyricLine>> current_lyrics;
   std::atomic_bool fetching_lyrics{false};
 
   // Callbacks
@@ -78,13 +128,63 @@ private:
   std::function<void(double, double)> on_time_update;
   std::function<void()> on_end_of_track_callback;
   std::function<void(const std::string &)> on_subtitle_change;
-
-  // Current track data for navigation
-  std::vector<Track> current_track_data;
-  int current_track_index = -1;
+  // Pushed changes for any number of followers
+  PlaybackEvents events;
 
   std::string current_url;
 
+  // Write-through audio cache; null when disabled in config
+  std::unique_ptr<AudioCache> audio_cache;
+
+  // Downloaded tracks, played from disk instead of the network
+  std::shared_ptr<LocalLibrary> library;
+
+  // Stream being recorded into the cache (guarded by player_mutex). Only
+  // recordings of uninterrupted plays are committed: mpv leaves gaps in
+  // the file when seeking during stream-record.
+  struct Recording {
+    std::string key;
+    std::string part;
+    bool file_loaded = false;
+    bool seeked = false;
+    std::optional<KeptTrack> keep; // set by keep_current()
+  };
+  std::optional<Recording> recording;
+  std::function<void(const KeptTrack &)> on_kept;
+
+  // Hot standby (player.hot_standby): a second mpv instance holding the
+  // next queue entry, loaded paused and muted, that swaps roles with the
+  // active one on skip or end of file. Guarded by player_mutex; destroyed
+  // only by the event thread, which may be waiting on a demoted handle.
+  std::unique_ptr<mpv_handle, decltype(&mpv_destroy)> standby{nullptr, mpv_destroy};
+  bool standby_enabled = false;
+  int standby_min_free_mb = 512;
+  std::string standby_url; // empty when nothing is loaded
+  bool standby_loaded = false;
+  int standby_quality = 0;
+  std::optional<Recording> standby_recording;
+  bool drop_standby = false;
+  int64_t last_memory_check = 0;
+  std::atomic_bool active_idle{false}; // active demuxer done reading
+  std::atomic_bool promoted{false};    // event thread owes a file-loaded pass
+
+  // Media URLs handed over by restore_session(), each used once by load()
+  std::map<std::string, std::string> handed_streams;
+  // The restored track, until it has loaded or another track replaced it
+  // (guarded by player_mutex). mpv's "start" and "pause" options hold its
+  // playhead meanwhile.
+  struct Resume {
+    std::string url;
+    bool paused;
+    bool handed_stream; // opened from handed_streams
+    std::shared_ptr<const std::vector<tuisic::LyricLine>> lyrics;
+  };
+  std::optional<Resume> resume_point;
+
+  // A standby only pre-rolls, so it gets a small fixed buffer
+  static constexpr ReadaheadController::Settings STANDBY_BUFFER{15.0, 8LL * 1024 * 1024};
+  static constexpr int64_t MEMORY_CHECK_INTERVAL = 5000000000LL; // ns
+
   // Logging utility
   void log_error(const std::string &message) {
     // std::cerr << "[MusicPlayer Error] " << message << std::endl;
@@ -107,97 +207,38 @@ private:
 public:
   MusicPlayer() : lyrics_fetcher(std::make_unique<tuisic::LyricsFetcher>()) {
     // Create MPV handle with error checking
-    mpv.reset(mpv_create());
+    mpv.reset(create_handle(readahead.current()));
     if (!mpv) {
-      log_error("Failed to create MPV instance");
       throw std::runtime_error("MPV initialization failed");
     }
+    active_mpv = mpv.get();
+    observe_properties(mpv.get());
 
-    // Configure MPV options from config
-    const std::vector<std::pair<std::string, std::string>> mpv_options = {
-        {"video", "no"},
-        {"audio-display", "no"}, 
-        {"terminal", "no"},
-        {"quiet", "yes"}, 
-        {"sub-auto", "fuzzy"},   
-        {"sub-codepage", "UTF-8"}
-    };
-
-    for (const auto &[option, default_value] : mpv_options) {
-      // For now use defaults, but this allows easy config integration later
-      if (mpv_set_option_string(mpv.get(), option.c_str(), default_value.c_str()) < 0) {
-        log_error("Failed to set option: " + option);
+    // Structural queue edits can change what plays next
+    play_queue.subscribe([this](const QueueChange &change) {
+      if (change.kind != QueueChange::Kind::CurrentChanged) {
+        refresh_standby();
       }
-    }
+    });
 
-#ifdef WITH_CAVA
+#ifdef WITH_VISUALIZER
     try {
-      visualizer = std::make_shared<AudioVisualizer>();
+      visualizer = std::make_unique<AudioVisualizer>(viz_bars.load(), AudioCapture::SAMPLE_RATE,
+                                                     AudioCapture::CHANNELS);
       audio_capture = std::make_shared<AudioCapture>();
 
-      // Set up audio capture callback
-      audio_capture->set_callback([this](const std::vector<double>& audio_data) {
-        static int callback_count = 0;
-        callback_count++;
-
-        if (callback_count == 1) {
-          std::cout << "[Player] Audio capture callback working! Received "
-                    << audio_data.size() << " samples" << std::endl;
-        }
-
-        if (visualizer && on_audio_data) {
-          // Process through visualizer
-          std::vector<double> viz_data;
-          {
-            std::lock_guard<std::mutex> lock(player_mutex);
-            viz_data = visualizer->process(audio_data);
-            visualization_data = viz_data;
-          }
-
-          if (callback_count % 100 == 0) {
-            std::cout << "[Player] Processed " << callback_count
-                      << " buffers, viz_data size: " << viz_data.size() << std::endl;
-          }
-
-          // Send to UI callback
-          if (!viz_data.empty()) {
-            on_audio_data(viz_data);
-          }
-        } else {
-          if (callback_count == 1) {
-            std::cerr << "[Player] Visualizer or on_audio_data callback missing!" << std::endl;
-          }
-        }
-      });
+      // The capture thread only wakes the visualizer thread; notify_one
+      // takes no lock, so it never blocks on it
+      audio_capture->set_notify([this] { viz_wake.notify_one(); });
+      audio_capture->set_error_handler([this](const std::string &message) { log_error(message); });
+      audio_capture->set_target(string_property(mpv.get(), "audio-client-name"));
+      viz_thread = std::thread([this] { visualize_loop(); });
 
     } catch (const std::exception& e) {
       log_error(std::string("Failed to initialize visualizer: ") + e.what());
     }
 #endif
 
-    // Property observation
-    mpv_observe_property(mpv.get(), 0, "time-pos", MPV_FORMAT_DOUBLE);
-    mpv_observe_property(mpv.get(), 0, "duration", MPV_FORMAT_DOUBLE);
-    mpv_observe_property(mpv.get(), 0, "sub-text", MPV_FORMAT_STRING);
-    // Set audio output based on platform
-#ifdef _WIN32
-    mpv_set_option_string(mpv.get(), "ao", "wasapi");
-#elif defined(__APPLE__)
-    mpv_set_option_string(mpv.get(), "ao", "coreaudio");
-#else
-    mpv_set_option_string(mpv.get(), "ao", "pulse");
-#endif
-
-
-    mpv_set_property_string(mpv.get(), "sid", "1");
-    mpv_request_event(mpv.get(), MPV_EVENT_TICK, true);
-
-    // Initialize MPV
-    if (mpv_initialize(mpv.get()) < 0) {
-      log_error("MPV initialization failed");
-      throw std::runtime_error("MPV initialization failed");
-    }
-
     // Start event handling thread
     event_thread = std::make_unique<std::thread>([this] { event_loop(); });
   }
@@ -213,6 +254,39 @@ public:
     if (event_thread && event_thread->joinable()) {
       event_thread->join();
     }
+#ifdef WITH_VISUALIZER
+    viz_wake.notify_one();
+    if (viz_thread.joinable()) {
+      viz_thread.join();
+    }
+#endif
+  }
+
+  // Applies settings that need the user config (audio cache)
+  void set_config(std::shared_ptr<Config> cfg) {
+    std::lock_guard<std::mutex> lock(player_mutex);
+    config = std::move(cfg);
+    library = std::make_shared<LocalLibrary>(paths::get_data_dir() + "/library.json");
+    if (config) {
+      bitrate.set_ceiling(config->get_max_bitrate_kbps());
+      standby_enabled = config->get_hot_standby();
+      standby_min_free_mb = config->get_standby_min_free_mb();
+      drop_standby = !standby_enabled && standby;
+#ifdef WITH_VISUALIZER
+      viz_fps = std::clamp(config->get_visualizer_fps(), 1, 120);
+      if (config->get_visualizer_bars() > 0) {
+        set_visualizer_bars(config->get_visualizer_bars());
+      }
+#endif
+    }
+    if (config && config->get_cache_enabled()) {
+      try {
+        audio_cache = std::make_unique<AudioCache>(config->get_cache_path(),
+                                                   config->get_cache_max_size_mb());
+      } catch (const std::exception &e) {
+        log_error(std::string("Audio cache disabled: ") + e.what());
+      }
+    }
   }
 
   void set_audio_callback(
@@ -222,22 +296,14 @@ public:
 
   // Subtitle management methods
   void update_subtitle(const char *new_subtitle) {
-    std::lock_guard<std::mutex> lock(player_mutex); // Thread-safe update
-
     // Only update if subtitles are enabled
-    if (subtitles_enabled) {
-      current_subtitle = new_subtitle ? new_subtitle : "";
-    } else {
-      current_subtitle = "";
-    }
-
-    if (on_subtitle_change) {
-      try {
-        on_subtitle_change(current_subtitle);
-      } catch (const std::exception &e) {
-        log_error("Subtitle callback failed: " + std::string(e.what()));
-      }
+    std::string text = subtitles_enabled && new_subtitle ? new_subtitle : "";
+    if (text == state.load()->subtitle) {
+      return;
     }
+    state.update([&](PlaybackSnapshot &s) { s.subtitle = text; });
+    notify_subtitle(text);
+    publish(PlaybackEvent::Kind::Lyric, text);
   }
 
   void toggle_subtitles() {
@@ -245,15 +311,7 @@ public:
 
     // Clear subtitle immediately when disabling
     if (!subtitles_enabled) {
-      std::lock_guard<std::mutex> lock(player_mutex);
-      current_subtitle = "";
-      if (on_subtitle_change) {
-        try {
-          on_subtitle_change(current_subtitle);
-        } catch (const std::exception &e) {
-          log_error("Subtitle callback failed: " + std::string(e.what()));
-        }
-      }
+      update_subtitle(nullptr);
     }
 
     notifications::send(subtitles_enabled ? "Subtitles enabled" : "Subtitles disabled");
@@ -265,7 +323,9 @@ public:
 
   // Fetch lyrics asynchronously for the current track
   void fetch_lyrics_async() {
-    if (current_track_index < 0 || current_track_index >= current_track_data.size()) {
+    // Get track info
+    Track current_track = state.load()->track;
+    if (current_track.name.empty()) {
       return;
     }
 
@@ -273,22 +333,23 @@ public:
       return; // Already fetching
     }
 
-    // Get track info
-    Track current_track = current_track_data[current_track_index];
-
     // Fetch in a separate thread to avoid blocking
     std::thread([this, current_track]() {
       try {
         auto lyrics_opt = lyrics_fetcher->fetch_lyrics(current_track.artist, current_track.name);
 
         if (lyrics_opt.has_value()) {
-          auto parsed_lyrics = lyrics_fetcher->parse_lrc(lyrics_opt.value());
+          auto parsed_lyrics = std::make_shared<const std::vector<tuisic::LyricLine>>(
+              lyrics_fetcher->parse_lrc(lyrics_opt.value()));
 
-          std::lock_guard<std::mutex> lock(player_mutex);
-          current_lyrics = std::move(parsed_lyrics);
-          has_lyrics = !current_lyrics.empty();
+          // Drop the result if the track changed while fetching
+          if (state.load()->track.url != current_track.url) {
+            fetching_lyrics = false;
+            return;
+          }
+          std::atomic_store(&current_lyrics, parsed_lyrics);
 
-          if (has_lyrics) {
+          if (!parsed_lyrics->empty()) {
             notifications::send("Lyrics loaded for: " + current_track.name);
           } else {
             notifications::send("No synced lyrics available for: " + current_track.name);
@@ -304,181 +365,228 @@ public:
     }).detach();
   }
 
-  std::string get_current_subtitle() const {
-    std::lock_guard<std::mutex> lock(player_mutex);
-    return current_subtitle;
-  }
-
-  // Track navigation methods
-  void previous_track(const std::vector<Track> &track_data,
-                      int &current_index) {
-    if (track_data.empty())
-      return;
+  std::string get_current_subtitle() const { return state.load()->subtitle; }
 
-    // Update track data and current track index
-    current_track_data = track_data;
-    current_track_index = current_index;
+  // Queue navigation. The queue holds the tracks; these only move the
+  // current entry and load it.
+  PlayQueue &queue() { return play_queue; }
+  const PlayQueue &queue() const { return play_queue; }
 
-    // Circular previous
-    current_index = (current_index - 1 + track_data.size()) % track_data.size();
-    play(track_data[current_index].url);
-  }
-
-  void next_track(const std::vector<Track> &track_data, int &current_index) {
-    if (track_data.empty())
-      return;
-
-    // Update track data and current track index
-    current_track_data = track_data;
-    current_track_index = current_index;
-    current_index = (current_index) % track_data.size();
-    play(track_data[current_index].url);
+  void previous_track() {
+    if (auto track = play_queue.retreat()) {
+      play(*track);
+    }
   }
 
-  void create_playlist(const std::vector<std::string> &urls) {
-    std::lock_guard<std::mutex> lock(player_mutex);
-    if (urls.empty()) {
-      log_error("No URLs provided for playlist");
-      return;
-    }
-    // Clear and swap playlist
-    playlist.clear();
-    // playlist.swap(const_cast<std::vector<std::string> &>(urls));
-    current_playlist_index = 0;
-    playlist = urls;
-    mpv_command_string(mpv.get(), "playlist-clear");
-    if (!playlist.empty()) {
-      const char *cmd[] = {"loadfile", playlist[0].c_str(), NULL};
-      int result = mpv_command(mpv.get(), cmd);
-      if (result < 0) {
-        // std::cerr << "Failed to load first track. Error code: " << result
-        //           << std::endl;
-          notifications::send("Failed to load first track. Error code: " + std::to_string(result));
-        return;
-      }
+  void next_track() {
+    if (auto track = play_queue.advance()) {
+      play(*track);
     }
   }
 
-  void shuffle_playlist() {
-    std::lock_guard<std::mutex> lock(player_mutex);
-    if (playlist.size() > 1) {
-      std::random_device rd;
-      std::mt19937 g(rd());
-      std::shuffle(playlist.begin(), playlist.end(), g);
-      current_playlist_index = 0;
+  void play_index(size_t index) {
+    if (auto track = play_queue.jump(index)) {
+      play(*track);
     }
   }
 
-  void play_playlist() {
-    if (playlist.empty())
+  // Replace the queue with `tracks` and start playing tracks[start]
+  void create_playlist(const std::vector<Track> &tracks, int start = 0) {
+    if (tracks.empty()) {
+      log_error("No tracks provided for playlist");
       return;
-
-    if (current_playlist_index == -1) {
-      current_playlist_index = 0;
     }
-    play(playlist[current_playlist_index]);
+    play_queue.assign(tracks, start);
+    if (auto track = play_queue.current_track()) {
+      play(*track);
+    }
   }
 
-  void next_track() {
-    std::lock_guard<std::mutex> lock(player_mutex);
-    if (playlist.empty())
-      return;
+  void shuffle_playlist() { play_queue.shuffle(); }
 
-    current_playlist_index = (current_playlist_index + 1) % playlist.size();
-    const char *cmd[] = {"loadfile", playlist[current_playlist_index].c_str(),
-                         NULL};
-    mpv_command(mpv.get(), cmd);
+  bool unshuffle_playlist() { return play_queue.unshuffle(); }
+
+  void play_playlist() {
+    auto track = play_queue.current_track();
+    if (!track) {
+      track = play_queue.jump(0);
+    }
+    if (track) {
+      play(*track);
+    }
   }
 
   void play(const std::string &url) {
     std::lock_guard<std::mutex> lock(player_mutex);
     if (url != current_url) {
-      const char *cmd[] = {"loadfile", url.c_str(), NULL};
-      mpv_command_async(mpv.get(), 0, cmd);
-      current_url = url;
-      is_loaded = true;
-      is_playing = true;
-
-#ifdef WITH_CAVA
-      // Start audio capture when playback begins
-      if (audio_capture) {
-        audio_capture->start();
+      if (recording) {
+        finish_recording(false);
       }
-#endif
+      if (resume_point) {
+        mpv_set_property_string(mpv.get(), "start", "none");
+        resume_point.reset();
+      }
+      int quality = 0;
+      if (standby && standby_url == url) {
+        quality = promote_standby();
+      } else {
+        auto snap = state.load();
+        Track track;
+        if (snap->track.url == url) {
+          track = snap->track;
+        } else {
+          track.url = url;
+        }
+        quality = load(mpv.get(), track, recording);
+        active_idle = false;
+      }
+      current_url = url;
+      state.update([&](PlaybackSnapshot &s) {
+        // Plain URL plays carry no track metadata
+        if (s.track.url != url) {
+          s.track = Track{};
+          s.track.url = url;
+        }
+        s.position = 0.0;
+        s.position_stamp = 0;
+        s.loaded = true;
+        s.quality_kbps = quality;
+      });
     }
 
     // If paused, unpause
-    if (is_paused) {
+    if (state.load()->paused) {
       const char *cmd[] = {"cycle", "pause", NULL};
       mpv_command_async(mpv.get(), 0, cmd);
-      is_paused = false;
-
-#ifdef WITH_CAVA
-      // Resume audio capture
-      if (audio_capture) {
-        audio_capture->start();
-      }
-#endif
+      set_paused(false);
     }
   }
 
   // Overload that accepts Track object for lyrics support
   void play(const Track &track) {
-    {
-      std::lock_guard<std::mutex> lock(player_mutex);
-      // Update current track data for lyrics fetching
-      current_track_data.clear();
-      current_track_data.push_back(track);
-      current_track_index = 0;
-    }
+    // Publish the track first so lyrics and frontends pick it up
+    state.update([&](PlaybackSnapshot &s) { s.track = track; });
     // Call the regular play method
     play(track.url);
   }
 
   void pause() {
     std::lock_guard<std::mutex> lock(player_mutex);
-    if (is_loaded) {
+    auto snap = state.load();
+    if (snap->loaded) {
       const char *cmd[] = {"cycle", "pause", NULL};
       mpv_command_async(mpv.get(), 0, cmd);
-      is_paused = !is_paused;
+      set_paused(!snap->paused);
     }
   }
 
   void resume() {
     std::lock_guard<std::mutex> lock(player_mutex);
-    if (is_paused) {
+    if (state.load()->paused) {
       const char *cmd[] = {"cycle", "pause", NULL};
       mpv_command_async(mpv.get(), 0, cmd);
-      is_paused = false;
+      set_paused(false);
     }
   }
 
   void togglePlayPause() {
     std::lock_guard<std::mutex> lock(player_mutex);
-    if (is_paused) {
-      const char *cmd[] = {"cycle", "pause", NULL};
-      mpv_command_async(mpv.get(), 0, cmd);
-      is_paused = false;
-    } else {
-      const char *cmd[] = {"cycle", "pause", NULL};
-      mpv_command_async(mpv.get(), 0, cmd);
-      is_paused = !is_paused;
-    }
-
+    const char *cmd[] = {"cycle", "pause", NULL};
+    mpv_command_async(mpv.get(), 0, cmd);
+    set_paused(!state.load()->paused);
   }
 
   std::string get_current_track() const {
     std::lock_guard<std::mutex> lock(player_mutex);
     return current_url;
   }
-  
-  std::string get_current_track_data() const {
+
+  std::string get_current_track_data() const { return state.load()->track.id; }
+
+  // Current published state; cheap, never blocks on the player threads
+  std::shared_ptr<const PlaybackSnapshot> snapshot() const { return state.load(); }
+
+  // Track changes, pause/resume, lyric lines, end of queue and position
+  PlaybackEvents &playback_events() { return events; }
+
+  // Playback state for another process to continue from (see
+  // restore_session)
+  PlaybackSession export_session() const {
     std::lock_guard<std::mutex> lock(player_mutex);
-    return current_track_data[current_track_index].id;
+    PlaybackSession session;
+    for (const auto &track : play_queue.tracks()) {
+      session.queue.push_back(*track);
+    }
+    session.index = std::max(play_queue.current_index(), 0);
+
+    auto snap = state.load();
+    session.position = snap->interpolated_position();
+    session.paused = snap->paused;
+    session.volume = snap->volume;
+    if (auto lyrics = std::atomic_load(&current_lyrics)) {
+      session.lyrics = *lyrics;
+    }
+
+    // What mpv actually opened, after yt-dlp; only worth passing on for
+    // network streams
+    auto add_stream = [&](const std::string &url, const std::string &stream) {
+      if (!stream.empty() && stream != url &&
+          (url.rfind("http://", 0) == 0 || url.rfind("https://", 0) == 0)) {
+        session.streams[url] = stream;
+      }
+    };
+    if (snap->loaded && !current_url.empty()) {
+      add_stream(current_url, string_property(mpv.get(), "stream-open-filename"));
+    }
+    if (standby && standby_loaded) {
+      add_stream(standby_url, string_property(standby.get(), "stream-open-filename"));
+    }
+    return session;
+  }
+
+  // Replaces the queue with `session` and continues its current track at
+  // the saved position, paused if it was, without fetching what the
+  // session already carries
+  void restore_session(const PlaybackSession &session) {
+    if (session.queue.empty()) {
+      return;
+    }
+    set_volume(session.volume);
+    play_queue.assign(session.queue, session.index);
+    auto track = play_queue.current_track();
+    if (!track) {
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(player_mutex);
+    if (recording) {
+      finish_recording(false);
+    }
+    handed_streams = session.streams;
+    resume_point = Resume{track->url, session.paused, handed_streams.count(track->url) > 0,
+                    session.lyrics.empty()
+                        ? nullptr
+                        : std::make_shared<const std::vector<tuisic::LyricLine>>(session.lyrics)};
+    std::string start = std::to_string(session.position);
+    mpv_set_property_string(mpv.get(), "start", start.c_str());
+    mpv_set_property_string(mpv.get(), "pause", session.paused ? "yes" : "no");
+
+    int quality = load(mpv.get(), *track, recording);
+    active_idle = false;
+    current_url = track->url;
+    state.update([&](PlaybackSnapshot &s) {
+      s.track = *track;
+      s.position = session.position;
+      s.position_stamp = 0;
+      s.loaded = true;
+      s.paused = session.paused;
+      s.quality_kbps = quality;
+    });
   }
 
   void seek(double position) {
     std::lock_guard<std::mutex> lock(player_mutex);
+    mark_seeked();
     std::string pos = std::to_string(position);
     const char *cmd[] = {"seek", pos.c_str(), "absolute", NULL};
     mpv_command_async(mpv.get(), 0, cmd);
@@ -486,12 +594,14 @@ public:
 
   void skip_forward() {
     std::lock_guard<std::mutex> lock(player_mutex);
+    mark_seeked();
     const char *cmd[] = {"seek", "5", "relative", NULL};
     mpv_command_async(mpv.get(), 0, cmd);
   }
 
   void skip_backward() {
     std::lock_guard<std::mutex> lock(player_mutex);
+    mark_seeked();
     const char *cmd[] = {"seek", "-5", "relative", NULL};
     mpv_command_async(mpv.get(), 0, cmd);
   }
@@ -500,79 +610,14 @@ public:
     std::lock_guard<std::mutex> lock(player_mutex);
     const char *cmd[] = {"stop", NULL};
     mpv_command_async(mpv.get(), 0, cmd);
-    is_loaded = false;
-    is_playing = false;
-    is_paused = false;
-    current_playlist_index = -1;
-  }
-
-  bool download_track(const std::string &url, const std::string path,
-                      const std::string &filename) {
-    std::lock_guard<std::mutex> lock(player_mutex);
-    /* std::string final_path = config->get_download_path(); */
-
-    std::string final_path = path + "/" + filename;
-    /* std::string final_path = "/home/dk/Music/" + filename; */
-
-    if (is_downloading) {
-      log_error("Already another download in progress");
-      return false;
+    if (recording) {
+      finish_recording(false);
     }
-
-    // Start download in a separate thread
-    std::thread download_thread([this, url, final_path]() {
-      is_downloading = true;
-
-      try {
-        // Construct yt-dlp command
-        // -x: Extract audio
-        // --audio-format mp3: Convert to MP3
-        // -o: Output template
-        std::string command = "yt-dlp -q -x --audio-format mp3 -o \"" +
-                              final_path + "\" \"" + url + "\"";
-
-        /* std::string command = */
-        /*     fmt::format("yt-dlp -x --audio-format {} -o \"{}\" \"{}\"", */
-        /*                 config->get_download_format(), final_path, url); */
-
-        // Execute the command
-        int result = system(command.c_str());
-
-        if (result != 0) {
-          throw std::runtime_error("yt-dlp failed to download the track");
-        }
-
-        // Notify completion
-        // system(("notify-send \"Download completed: " + final_path + "\"").c_str());
-        notifications::send_download_complete("" + final_path);
-
-      } catch (const std::exception &e) {
-        log_error(e.what());
-        // system(
-        //     ("notify-send \"Download failed: " + std::string(e.what()) + "\"")
-        //         .c_str());
-        notifications::send_download_failed("" + std::string(e.what()));
-      }
-
-      is_downloading = false;
+    unload_standby();
+    state.update([](PlaybackSnapshot &s) {
+      s.loaded = false;
+      s.paused = false;
     });
-
-    download_thread.detach();
-
-    return true;
-  }
-
-  bool is_download_in_progress() const { return is_downloading; }
-
-  void on_track_end() {
-    std::lock_guard<std::mutex> lock(player_mutex);
-    current_playlist_index++;
-    if (current_playlist_index < playlist.size()) {
-      // Play next track
-      const char *cmd[] = {"loadfile", playlist[current_playlist_index].c_str(),
-                           NULL};
-      mpv_command(mpv.get(), cmd);
-    }
   }
 
   void toggle_repeat() {
@@ -581,29 +626,37 @@ public:
     mpv_command_async(mpv.get(), 0, cmd);
   }
 
-  int get_current_playlist_index() const {
-    std::lock_guard<std::mutex> lock(player_mutex);
-    return current_playlist_index;
-  }
+  int get_current_playlist_index() const { return play_queue.current_index(); }
 
   void set_volume(int volume) {
     std::lock_guard<std::mutex> lock(player_mutex);
     int64_t mpv_volume = std::clamp(volume, 0, 100);
     mpv_set_property_async(mpv.get(), 0, "volume", MPV_FORMAT_INT64,
                            &mpv_volume);
+    state.update([&](PlaybackSnapshot &s) { s.volume = static_cast<int>(mpv_volume); });
   }
 
-  int get_volume() const {
-    std::lock_guard<std::mutex> lock(player_mutex);
-    int64_t volume = 100;
-    mpv_get_property(mpv.get(), "volume", MPV_FORMAT_INT64, &volume);
-    return static_cast<int>(volume);
+  // Tracked through the observed "volume" property, no mpv round-trip
+  int get_volume() const { return state.load()->volume; }
+
+  std::shared_ptr<const std::vector<double>> get_visualization_data() const {
+    return state.load()->viz_frame;
   }
 
-  std::vector<double> get_visualization_data() const {
-    std::lock_guard<std::mutex> lock(player_mutex);
-    return visualization_data;
+#ifdef WITH_VISUALIZER
+  // Bars in the frames that follow; taken up on the next visualizer tick
+  void set_visualizer_bars(int bars) { viz_bars = std::clamp(bars, 1, 512); }
+  int get_visualizer_bars() const { return viz_bars; }
+
+  // Called by the bars panel on every draw; capture resumes when it
+  // reappears and is suspended once it has not been drawn for a while
+  void mark_visualizer_drawn() {
+    int64_t now = PlaybackSnapshot::clock_now();
+    if (now - viz_drawn_stamp.exchange(now) > VIZ_HIDDEN_AFTER_NS) {
+      kick_visualizer();
+    }
   }
+#endif
 
   // Callback setters
 
@@ -629,13 +682,156 @@ public:
     on_end_of_track_callback = std::move(callback);
   }
 
+  // Index of downloaded tracks; null until set_config()
+  std::shared_ptr<LocalLibrary> get_library() const {
+    std::lock_guard<std::mutex> lock(player_mutex);
+    return library;
+  }
+
+  // Receives kept tracks once their recording ends. Runs with the player
+  // lock held, so it must not call back into the player.
+  void set_keep_callback(std::function<void(const KeptTrack &)> callback) {
+    std::lock_guard<std::mutex> lock(player_mutex);
+    on_kept = std::move(callback);
+  }
+
+  // Keep mode: save the playing track to `output` from the stream mpv is
+  // already recording instead of downloading it again. The result arrives
+  // through the keep callback when the track ends or is skipped. Returns
+  // false when `track` is not playing or not being recorded (audio cache
+  // disabled); the caller should download it normally then.
+  bool keep_current(const Track &track, const std::string &output,
+                    const std::string &format) {
+    std::lock_guard<std::mutex> lock(player_mutex);
+    if (!audio_cache || !on_kept || track.url != current_url) {
+      return false;
+    }
+    KeptTrack kept{track, output, format};
+    if (recording) {
+      recording->keep = kept;
+      return true;
+    }
+
+    // Played from the cache: the whole track is already on disk
+    auto cached = audio_cache->lookup(AudioCache::key_for(track));
+    if (!cached || !link_or_copy(*cached, kept_path(output))) {
+      return false;
+    }
+    kept.file = kept_path(output);
+    kept.complete = true;
+    on_kept(kept);
+    return true;
+  }
+
 private:
+  // Reply id for observed properties, so they can be dropped on demotion
+  static constexpr uint64_t OBSERVE_ID = 1;
+
+  // A configured and initialized mpv instance; null on failure
+  mpv_handle *create_handle(const ReadaheadController::Settings &buffer) {
+    mpv_handle *handle = mpv_create();
+    if (!handle) {
+      log_error("Failed to create MPV instance");
+      return nullptr;
+    }
+
+    // Each instance is its own audio client, so the visualizer can tell
+    // the active stream from a preloading standby
+    mpv_set_option_string(handle, "audio-client-name",
+                          ("tuisic-" + std::to_string(++handle_serial)).c_str());
+
+    // Configure MPV options from config
+    const std::vector<std::pair<std::string, std::string>> mpv_options = {
+        {"video", "no"},
+        {"audio-display", "no"}, 
+        {"terminal", "no"},
+        {"quiet", "yes"}, 
+        {"sub-auto", "fuzzy"},   
+        {"sub-codepage", "UTF-8"}
+    };
+
+    for (const auto &[option, default_value] : mpv_options) {
+      // For now use defaults, but this allows easy config integration later
+      if (mpv_set_option_string(handle, option.c_str(), default_value.c_str()) < 0) {
+        log_error("Failed to set option: " + option);
+      }
+    }
+
+    // Network cache, resized by the readahead controller as the link
+    // proves slow or fast
+    mpv_set_option_string(handle, "cache", "yes");
+    mpv_set_option_string(handle, "cache-secs", std::to_string(buffer.readahead_secs).c_str());
+    mpv_set_option_string(handle, "demuxer-readahead-secs",
+                          std::to_string(buffer.readahead_secs).c_str());
+    mpv_set_option_string(handle, "demuxer-max-bytes", std::to_string(buffer.max_bytes).c_str());
+
+    // Set audio output based on platform
+#ifdef _WIN32
+    mpv_set_option_string(handle, "ao", "wasapi");
+#elif defined(__APPLE__)
+    mpv_set_option_string(handle, "ao", "coreaudio");
+#else
+    mpv_set_option_string(handle, "ao", "pulse");
+#endif
+
+
+    mpv_set_property_string(handle, "sid", "1");
+    mpv_request_event(handle, MPV_EVENT_TICK, true);
+
+    // Initialize MPV
+    if (mpv_initialize(handle) < 0) {
+      log_error("MPV initialization failed");
+      mpv_destroy(handle);
+      return nullptr;
+    }
+    return handle;
+  }
+
+  // Empty when unavailable
+  static std::string string_property(mpv_handle *handle, const char *name) {
+    char *value = mpv_get_property_string(handle, name);
+    std::string result = value ? value : "";
+    mpv_free(value);
+    return result;
+  }
+
+  // Property observation. Observing again sends the current values, which
+  // is how a promoted standby brings the snapshot up to date.
+  static void observe_properties(mpv_handle *handle) {
+    mpv_observe_property(handle, OBSERVE_ID, "time-pos", MPV_FORMAT_DOUBLE);
+    mpv_observe_property(handle, OBSERVE_ID, "duration", MPV_FORMAT_DOUBLE);
+    mpv_observe_property(handle, OBSERVE_ID, "sub-text", MPV_FORMAT_STRING);
+    mpv_observe_property(handle, OBSERVE_ID, "paused-for-cache", MPV_FORMAT_FLAG);
+    mpv_observe_property(handle, OBSERVE_ID, "volume", MPV_FORMAT_DOUBLE);
+    mpv_observe_property(handle, OBSERVE_ID, "demuxer-cache-duration", MPV_FORMAT_DOUBLE);
+    mpv_observe_property(handle, OBSERVE_ID, "demuxer-via-network", MPV_FORMAT_FLAG);
+    mpv_observe_property(handle, OBSERVE_ID, "demuxer-cache-idle", MPV_FORMAT_FLAG);
+    mpv_observe_property(handle, OBSERVE_ID, "cache-speed", MPV_FORMAT_INT64);
+    mpv_observe_property(handle, OBSERVE_ID, "audio-bitrate", MPV_FORMAT_DOUBLE);
+    mpv_observe_property(handle, OBSERVE_ID, "core-idle", MPV_FORMAT_FLAG);
+  }
+
   void event_loop() {
     while (running) {
-      mpv_event *event = mpv_wait_event(mpv.get(), 0.1);
+      mpv_handle *handle;
+      {
+        std::lock_guard<std::mutex> lock(player_mutex);
+        service_standby();
+        handle = mpv.get();
+      }
+      if (promoted.exchange(false)) {
+        apply_readahead(readahead.current());
+        handle_file_loaded();
+      }
+
+      mpv_event *event = mpv_wait_event(handle, 0.1);
       if (event->event_id == MPV_EVENT_NONE) {
         continue;
       }
+      // Demoted to standby during the wait: what it reports is stale
+      if (handle != active_mpv.load()) {
+        continue;
+      }
 
       switch (event->event_id) {
       case MPV_EVENT_PROPERTY_CHANGE: {
@@ -654,21 +850,18 @@ private:
         break;
       case MPV_EVENT_TICK: {
         // Priority: fetched lyrics > mpv subtitles
-        if (has_lyrics && !current_lyrics.empty()) {
+        auto lyrics = std::atomic_load(&current_lyrics);
+        if (lyrics && !lyrics->empty()) {
           // Use fetched lyrics synced with playback position
-          double pos = get_position();
-          std::string lyric_text;
-          {
-            std::lock_guard<std::mutex> lock(player_mutex);
-            lyric_text = lyrics_fetcher->get_current_lyric(current_lyrics, pos);
-          }
-          if (!lyric_text.empty() && lyric_text != current_subtitle) {
+          std::string lyric_text =
+              lyrics_fetcher->get_current_lyric(*lyrics, get_position());
+          if (!lyric_text.empty()) {
             update_subtitle(lyric_text.c_str());
           }
         } else {
           // Fallback to mpv subtitles (for YouTube)
           char *sub_text = NULL;
-          if (mpv_get_property(mpv.get(), "sub-text", MPV_FORMAT_STRING,
+          if (mpv_get_property(handle, "sub-text", MPV_FORMAT_STRING,
                                &sub_text) >= 0) {
             if (sub_text) {
               update_subtitle(sub_text);
@@ -685,64 +878,602 @@ private:
   void handle_property_change(mpv_event_property *prop) {
     if (strcmp(prop->name, "time-pos") == 0 &&
                prop->format == MPV_FORMAT_DOUBLE) {
-      current_position = *static_cast<double *>(prop->data);
+      double pos = *static_cast<double *>(prop->data);
+      int64_t now = PlaybackSnapshot::clock_now();
+      state.update([&](PlaybackSnapshot &s) {
+        s.position = pos;
+        s.position_stamp = now;
+      });
 
-      if (on_time_update) {
-        on_time_update(current_position, duration);
+      // Listeners interpolate between reports, so only resync them about
+      // once a second or when the position jumps (seek, new file).
+      double expected =
+          notified_position + (now - notified_stamp) / 1e9;
+      bool jumped = std::abs(pos - expected) > 1.0 || !is_playing_state();
+      if (jumped || now - notified_stamp >= 1000000000LL) {
+        notified_position = pos;
+        notified_stamp = now;
+        if (on_time_update) {
+          on_time_update(pos, get_duration());
+        }
+        publish(PlaybackEvent::Kind::Position);
       }
     } else if (strcmp(prop->name, "duration") == 0 &&
                prop->format == MPV_FORMAT_DOUBLE) {
-      duration = *static_cast<double *>(prop->data);
+      double dur = *static_cast<double *>(prop->data);
+      state.update([&](PlaybackSnapshot &s) { s.duration = dur; });
+    } else if (strcmp(prop->name, "paused-for-cache") == 0 &&
+               prop->format == MPV_FORMAT_FLAG) {
+      bool buffering = *static_cast<int *>(prop->data) != 0;
+      auto snap = state.load();
+      if (buffering && snap->streaming && snap->playing() && !snap->buffering) {
+        apply_readahead(readahead.on_underrun());
+        bitrate.on_stall();
+      }
+      state.update([&](PlaybackSnapshot &s) {
+        rebase_clock(s);
+        s.buffering = buffering;
+      });
+    } else if (strcmp(prop->name, "volume") == 0 &&
+               prop->format == MPV_FORMAT_DOUBLE) {
+      int vol = static_cast<int>(std::lround(*static_cast<double *>(prop->data)));
+      state.update([&](PlaybackSnapshot &s) { s.volume = vol; });
+    } else if (strcmp(prop->name, "demuxer-cache-duration") == 0) {
+      // Unavailable (MPV_FORMAT_NONE) between files
+      double ahead = prop->format == MPV_FORMAT_DOUBLE
+                         ? *static_cast<double *>(prop->data)
+                         : -1.0;
+      state.update([&](PlaybackSnapshot &s) { s.cache_duration = ahead; });
+    } else if (strcmp(prop->name, "demuxer-via-network") == 0) {
+      bool network = prop->format == MPV_FORMAT_FLAG &&
+                     *static_cast<int *>(prop->data) != 0;
+      state.update([&](PlaybackSnapshot &s) { s.streaming = network; });
+    } else if (strcmp(prop->name, "core-idle") == 0 &&
+               prop->format == MPV_FORMAT_FLAG) {
+      // Paused, stopped, buffering or idle after the queue: no audio out
+#ifdef WITH_VISUALIZER
+      audio_idle = *static_cast<int *>(prop->data) != 0;
+      kick_visualizer();
+#endif
+    } else if (strcmp(prop->name, "demuxer-cache-idle") == 0) {
+      active_idle = prop->format == MPV_FORMAT_FLAG && *static_cast<int *>(prop->data) != 0;
+      if (active_idle) {
+        refresh_standby();
+      }
+    } else if (strcmp(prop->name, "cache-speed") == 0 &&
+               prop->format == MPV_FORMAT_INT64) {
+      int64_t speed = *static_cast<int64_t *>(prop->data);
+      int64_t now = PlaybackSnapshot::clock_now();
+      auto snap = state.load();
+      if (snap->streaming && snap->playing() && last_speed_sample > 0) {
+        double elapsed = (now - last_speed_sample) / 1e9;
+        apply_readahead(readahead.on_sample(speed, elapsed));
+        bitrate.on_sample(readahead.get_stats().throughput, elapsed);
+      }
+      last_speed_sample = now;
+    } else if (strcmp(prop->name, "audio-bitrate") == 0 &&
+               prop->format == MPV_FORMAT_DOUBLE) {
+      apply_readahead(readahead.on_bitrate(
+          static_cast<int64_t>(*static_cast<double *>(prop->data))));
+    }
+  }
+
+  // Event thread. Pushes new buffer limits to mpv and publishes the stats.
+  void apply_readahead(const std::optional<ReadaheadController::Settings> &settings) {
+    if (settings) {
+      set_buffer(active_mpv.load(), *settings);
+    }
+    const auto &stats = readahead.get_stats();
+    state.update([&](PlaybackSnapshot &s) { s.stream_stats = stats; });
+  }
+
+  // Fold the locally advanced time into the reported position before the
+  // clock stops or starts running.
+  static void rebase_clock(PlaybackSnapshot &s) {
+    s.position = s.interpolated_position();
+    s.position_stamp = PlaybackSnapshot::clock_now();
+  }
+
+  void set_paused(bool paused) {
+    bool changed = false;
+    state.update([&](PlaybackSnapshot &s) {
+      rebase_clock(s);
+      changed = s.paused != paused;
+      s.paused = paused;
+    });
+    if (changed) {
+      publish(paused ? PlaybackEvent::Kind::Paused : PlaybackEvent::Kind::Resumed);
+    }
+  }
+
+  void publish(PlaybackEvent::Kind kind, std::string text = "") {
+    events.publish({kind, state.load(), std::move(text)});
+  }
+
+  void notify_subtitle(const std::string &text) {
+    if (on_subtitle_change) {
+      try {
+        on_subtitle_change(text);
+      } catch (const std::exception &e) {
+        log_error("Subtitle callback failed: " + std::string(e.what()));
+      }
+    }
+  }
+
+#ifdef WITH_VISUALIZER
+  void kick_visualizer() {
+    viz_kick = true;
+    viz_wake.notify_one();
+  }
+
+  bool visualizer_wanted() const {
+    return !audio_idle &&
+           PlaybackSnapshot::clock_now() - viz_drawn_stamp.load() <= VIZ_HIDDEN_AFTER_NS;
+  }
+
+  // Visualizer thread, ticking at viz_fps independently of the capture
+  // cadence. Each tick runs the spectrum over the newest window in the
+  // ring, averages the channels, applies rise/gravity in real time and
+  // publishes a ready-to-draw frame of bar levels (0..1). Once the bars
+  // have settled and no audio arrives it sleeps until samples do, and
+  // while visualizer_wanted() is false capture is corked as well.
+  void visualize_loop() {
+    using Clock = std::chrono::steady_clock;
+    SampleRing &ring = audio_capture->samples();
+    VisualizerStep step;
+    auto last_tick = Clock::now();
+    auto next_tick = last_tick;
+    bool settled = true;
+    bool capturing = false;
+    VisualizerStats stats;
+    stats.stamp = PlaybackSnapshot::clock_now();
+    auto accounted = Clock::now();
+
+    // (Re)builds the spectrum for the requested bar count
+    auto configure = [&]() -> bool {
+      size_t wanted = viz_bars.load();
+      if (!visualizer || static_cast<size_t>(visualizer->get_num_bars()) != wanted) {
+        try {
+          visualizer = std::make_unique<AudioVisualizer>(
+              static_cast<int>(wanted), AudioCapture::SAMPLE_RATE, AudioCapture::CHANNELS);
+        } catch (const std::exception &e) {
+          log_error(std::string("Failed to resize visualizer: ") + e.what());
+          viz_bars = static_cast<int>(step.bars());
+          return visualizer != nullptr;
+        }
+      }
+      if (step.bars() != wanted) {
+        step.configure(*visualizer, AudioCapture::CHANNELS);
+      }
+      return true;
+    };
+
+    // Time spent capturing or suspended, for the stats line
+    auto account = [&](Clock::time_point now) {
+      double elapsed = std::chrono::duration<double>(now - accounted).count();
+      (capturing ? stats.active_secs : stats.suspended_secs) += elapsed;
+      stats.stamp = PlaybackSnapshot::clock_now();
+      accounted = now;
+    };
+
+    // Corks or resumes capture to match visualizer_wanted(). The stream
+    // and server connection stay up, so resuming costs no reconnect.
+    auto apply_policy = [&] {
+      bool wanted = visualizer_wanted();
+      if (wanted == capturing) {
+        return;
+      }
+      account(Clock::now());
+      capturing = wanted;
+      if (wanted) {
+        ring.skip(ring.available()); // audio from before the pause
+        audio_capture->start();
+      }
+      audio_capture->set_active(wanted);
+      stats.suspended = !wanted;
+      stats.suspensions += wanted ? 0 : 1;
+      state.update([&](PlaybackSnapshot &s) { s.viz_stats = stats; });
+    };
+
+    while (running) {
+      apply_policy();
+      if (settled) {
+        std::unique_lock<std::mutex> lock(viz_mutex);
+        viz_wake.wait_for(lock, std::chrono::milliseconds(250), [&] {
+          return !running || ring.available() > 0 || viz_kick.exchange(false);
+        });
+        if (!running || ring.available() == 0) {
+          continue;
+        }
+        next_tick = last_tick = Clock::now();
+      }
+
+      if (!configure()) {
+        return;
+      }
+      auto period = std::chrono::microseconds(1000000 / viz_fps.load());
+      next_tick += period;
+      auto now = Clock::now();
+      if (next_tick < now) {
+        next_tick = now; // fell behind; do not try to catch up
+      }
+      std::this_thread::sleep_until(next_tick);
+      now = Clock::now();
+      double dt = std::chrono::duration<double>(now - last_tick).count();
+      last_tick = now;
+
+      if (step.analyze(ring, *visualizer, dt) > 0) {
+        stats.spectra++;
+      }
+      const auto &levels = step.advance(dt);
+      settled = step.settled();
+      stats.frames++;
+      account(now);
+      auto frame = std::make_shared<const std::vector<double>>(levels);
+      state.update([&](PlaybackSnapshot &s) {
+        s.viz_frame = frame;
+        s.viz_stats = stats;
+      });
+      if (on_audio_data) {
+        on_audio_data(*frame);
+      }
     }
   }
+#endif
 
   void handle_playback_restart() {
-    is_playing = true;
     if (on_state_change) {
       on_state_change();
     }
   }
 
+  // Caller holds player_mutex. Returns what to hand to mpv for `track`: a
+  // downloaded copy or cached file if there is one, else its url, to be
+  // recorded into `rec` as it plays.
+  std::string resolve_location(const Track &track, std::optional<Recording> &rec) {
+    if (library) {
+      if (auto path = library->resolve(track)) {
+        return *path;
+      }
+    }
+    if (!audio_cache) {
+      return track.url;
+    }
+
+    std::string key = AudioCache::key_for(track);
+    if (auto path = audio_cache->lookup(key)) {
+      return *path;
+    }
+
+    // Local files are already on disk
+    if (track.url.rfind("http://", 0) != 0 && track.url.rfind("https://", 0) != 0) {
+      return track.url;
+    }
+    rec = Recording{key, audio_cache->part_path(key)};
+    return track.url;
+  }
+
+  // Caller holds player_mutex. Starts loading `track` into `handle`,
+  // recording the stream into `rec` where it should be cached. Returns the
+  // quality ceiling requested, 0 for local files.
+  int load(mpv_handle *handle, const Track &track, std::optional<Recording> &rec) {
+    std::string location = resolve_location(track, rec);
+    if (rec) {
+      mpv_set_property_string(handle, "stream-record", rec->part.c_str());
+    }
+    int quality = 0;
+    auto handed = handed_streams.find(track.url);
+    if (location == track.url && handed != handed_streams.end()) {
+      // Resolved by the process that handed playback over
+      location = handed->second;
+      handed_streams.erase(handed);
+      quality = bitrate.current_kbps();
+    } else if (location == track.url) {
+      // Read by mpv's yt-dlp hook when it resolves a page URL
+      mpv_set_property_string(handle, "ytdl-format", bitrate.ytdl_format().c_str());
+      quality = bitrate.current_kbps();
+    }
+    const char *cmd[] = {"loadfile", location.c_str(), NULL};
+    mpv_command_async(handle, 0, cmd);
+    return quality;
+  }
+
+  static void set_buffer(mpv_handle *handle, const ReadaheadController::Settings &settings) {
+    double secs = settings.readahead_secs;
+    mpv_set_property_async(handle, 0, "cache-secs", MPV_FORMAT_DOUBLE, &secs);
+    mpv_set_property_async(handle, 0, "demuxer-readahead-secs", MPV_FORMAT_DOUBLE, &secs);
+    std::string bytes = std::to_string(settings.max_bytes);
+    const char *value = bytes.c_str();
+    mpv_set_property_async(handle, 0, "demuxer-max-bytes", MPV_FORMAT_STRING, &value);
+  }
+
+  // MemAvailable in MiB; -1 where the kernel does not report it
+  static int64_t available_memory_mb() {
+    FILE *f = fopen("/proc/meminfo", "r");
+    if (!f) {
+      return -1;
+    }
+    char line[256];
+    long long kb = -1;
+    while (fgets(line, sizeof(line), f)) {
+      if (sscanf(line, "MemAvailable: %lld kB", &kb) == 1) {
+        break;
+      }
+    }
+    fclose(f);
+    return kb < 0 ? -1 : kb / 1024;
+  }
+
+  bool memory_low() const {
+    int64_t available = available_memory_mb();
+    return available >= 0 && available < standby_min_free_mb;
+  }
+
+  // Load the next queue entry into the standby once the active stream has
+  // buffered what it needs, so the two never compete for bandwidth
+  void refresh_standby() {
+    std::lock_guard<std::mutex> lock(player_mutex);
+    if (!standby_enabled || drop_standby || !active_idle) {
+      return;
+    }
+    auto next = play_queue.peek_next();
+    if (!next || next->url == current_url) {
+      unload_standby();
+      return;
+    }
+    if (next->url == standby_url || memory_low()) {
+      return;
+    }
+    if (!standby) {
+      standby.reset(create_handle(STANDBY_BUFFER));
+      if (!standby) {
+        standby_enabled = false;
+        return;
+      }
+    }
+
+    unload_standby();
+    mpv_set_property_string(standby.get(), "pause", "yes");
+    mpv_set_property_string(standby.get(), "mute", "yes");
+    standby_quality = load(standby.get(), *next, standby_recording);
+    standby_url = next->url;
+    standby_loaded = false;
+  }
+
+  // Caller holds player_mutex. Empties the standby, keeping the instance.
+  void unload_standby() {
+    if (!standby) {
+      return;
+    }
+    if (standby_recording) {
+      mpv_set_property_string(standby.get(), "stream-record", "");
+      audio_cache->discard(standby_recording->part);
+      standby_recording.reset();
+    }
+    if (!standby_url.empty()) {
+      const char *cmd[] = {"stop", NULL};
+      mpv_command_async(standby.get(), 0, cmd);
+      standby_url.clear();
+      standby_loaded = false;
+    }
+  }
+
+  // Caller holds player_mutex. Consumes the standby's events; only its
+  // load result matters.
+  void drain_standby() {
+    while (standby) {
+      mpv_event *event = mpv_wait_event(standby.get(), 0);
+      if (event->event_id == MPV_EVENT_NONE) {
+        break;
+      }
+      if (event->event_id == MPV_EVENT_FILE_LOADED) {
+        standby_loaded = true;
+        if (standby_recording) {
+          standby_recording->file_loaded = true;
+        }
+      } else if (event->event_id == MPV_EVENT_END_FILE &&
+                 static_cast<mpv_event_end_file *>(event->data)->reason ==
+                     MPV_END_FILE_REASON_ERROR) {
+        // Failed to open; play() loads it the normal way instead
+        unload_standby();
+      }
+    }
+  }
+
+  // Caller holds player_mutex. The standby becomes the active instance and
+  // the old one, stopped, becomes the standby. Returns the quality the
+  // promoted stream was requested at.
+  int promote_standby() {
+    drain_standby();
+
+    mpv_handle *old = mpv.get();
+    mpv_unobserve_property(old, OBSERVE_ID);
+    const char *stop_cmd[] = {"stop", NULL};
+    mpv_command_async(old, 0, stop_cmd);
+    mpv_set_property_string(old, "pause", "yes");
+    mpv_set_property_string(old, "mute", "yes");
+    set_buffer(old, STANDBY_BUFFER);
+
+    std::swap(mpv, standby);
+    active_mpv = mpv.get();
+#ifdef WITH_VISUALIZER
+    if (audio_capture) {
+      audio_capture->set_target(string_property(mpv.get(), "audio-client-name"));
+    }
+#endif
+    recording = std::move(standby_recording);
+    standby_recording.reset();
+
+    int64_t volume = state.load()->volume;
+    mpv_set_property_async(mpv.get(), 0, "volume", MPV_FORMAT_INT64, &volume);
+    mpv_set_property_string(mpv.get(), "mute", "no");
+    mpv_set_property_string(mpv.get(), "pause", "no");
+    set_paused(false);
+    observe_properties(mpv.get());
+
+    // Already loaded: no FILE_LOADED will follow on this handle, so the
+    // event thread runs that step itself. It may be waiting on `old`.
+    active_idle = false;
+    if (standby_loaded) {
+      promoted = true;
+      mpv_wakeup(old);
+    }
+    int quality = standby_quality;
+    standby_url.clear();
+    standby_loaded = false;
+    return quality;
+  }
+
+  // Caller holds player_mutex; event thread
+  void service_standby() {
+    int64_t now = PlaybackSnapshot::clock_now();
+    if (standby && !drop_standby && now - last_memory_check >= MEMORY_CHECK_INTERVAL) {
+      last_memory_check = now;
+      if (memory_low()) {
+        drop_standby = true;
+      }
+    }
+    if (drop_standby) {
+      unload_standby();
+      standby.reset();
+      drop_standby = false;
+      return;
+    }
+    drain_standby();
+  }
+
+  static std::string kept_path(const std::string &output) {
+    return std::filesystem::path(output).replace_extension(".kept.mka").string();
+  }
+
+  // Hard link when source and destination share a filesystem
+  static bool link_or_copy(const std::string &from, const std::string &to) {
+    std::error_code ec;
+    std::filesystem::remove(to, ec);
+    std::filesystem::create_hard_link(from, to, ec);
+    if (ec) {
+      ec.clear();
+      std::filesystem::copy_file(from, to, ec);
+    }
+    return !ec;
+  }
+
+  // Caller holds player_mutex
+  void finish_recording(bool completed) {
+    mpv_set_property_string(mpv.get(), "stream-record", "");
+
+    // A recording with seek gaps is useless; the download starts over
+    if (recording->keep && on_kept) {
+      KeptTrack &kept = *recording->keep;
+      std::error_code ec;
+      if (recording->file_loaded && !recording->seeked &&
+          std::filesystem::file_size(recording->part, ec) > 0 &&
+          link_or_copy(recording->part, kept_path(kept.output))) {
+        kept.file = kept_path(kept.output);
+        kept.complete = completed;
+        if (!completed) {
+          kept.stream = string_property(mpv.get(), "stream-open-filename");
+        }
+      }
+      on_kept(kept);
+    }
+
+    if (completed && !recording->seeked) {
+      audio_cache->commit(recording->key, recording->part);
+    } else {
+      audio_cache->discard(recording->part);
+    }
+    recording.reset();
+  }
+
+  // Caller holds player_mutex
+  void mark_seeked() {
+    if (recording) {
+      recording->seeked = true;
+    }
+  }
+
   void handle_end_file(mpv_event_end_file *prop) {
+    if (prop->reason == MPV_END_FILE_REASON_ERROR) {
+      std::lock_guard<std::mutex> lock(player_mutex);
+      if (resume_point && resume_point->handed_stream) {
+        // The handed-over URL expired; resolve the track again
+        resume_point->handed_stream = false;
+        load(mpv.get(), state.load()->track, recording);
+        return;
+      }
+    }
+    {
+      // END_FILE for a file replaced before it loaded belongs to an older
+      // recording, which play() already discarded.
+      std::lock_guard<std::mutex> lock(player_mutex);
+      if (recording && recording->file_loaded) {
+        finish_recording(prop->reason == MPV_END_FILE_REASON_EOF);
+      }
+    }
+
     if (prop->reason == MPV_END_FILE_REASON_EOF) {
+      // The queue wraps around after its last entry
+      int index = play_queue.current_index();
+      if (index >= 0 && index + 1 == static_cast<int>(play_queue.size())) {
+        publish(PlaybackEvent::Kind::QueueEnded);
+      }
+      // Advance first so the callback sees the new current entry
+      next_track();
       if (on_end_of_track_callback) {
         on_end_of_track_callback();
       }
-      next_track();
     }
   }
 
   void handle_file_loaded() {
-    is_loaded = true;
-    is_playing = true;
-    is_paused = false;
-
-    // Clear previous lyrics and subtitle, then fetch new ones
+    std::optional<Resume> resumed;
     {
       std::lock_guard<std::mutex> lock(player_mutex);
-      current_lyrics.clear();
-      has_lyrics = false;
-      current_subtitle = "";
-
-      // Notify UI to clear subtitle display
-      if (on_subtitle_change) {
-        try {
-          on_subtitle_change(current_subtitle);
-        } catch (const std::exception &e) {
-          log_error("Subtitle callback failed: " + std::string(e.what()));
-        }
+      if (recording) {
+        recording->file_loaded = true;
       }
+      if (resume_point) {
+        resumed = std::move(resume_point);
+        resume_point.reset();
+        mpv_set_property_string(mpv.get(), "start", "none");
+        // Recorded from mid-track: not a complete copy
+        mark_seeked();
+      }
+    }
+
+    // Clear previous lyrics and subtitle, then fetch new ones unless they
+    // came with a restored session
+    bool has_lyrics = resumed && resumed->lyrics;
+    std::atomic_store(&current_lyrics, has_lyrics
+                                           ? resumed->lyrics
+                                           : std::shared_ptr<const std::vector<tuisic::LyricLine>>());
+    bool paused = resumed && resumed->paused;
+    state.update([paused](PlaybackSnapshot &s) {
+      s.loaded = true;
+      s.paused = paused;
+      s.subtitle.clear();
+    });
+
+    // Notify UI to clear subtitle display
+    notify_subtitle("");
+    if (!has_lyrics) {
+      fetch_lyrics_async();
     }
-    fetch_lyrics_async();
 
+    publish(PlaybackEvent::Kind::TrackChanged);
     if (on_state_change) {
       on_state_change();
     }
   }
 
 public:
-  bool is_playing_state() const { return is_loaded && !is_paused; }
-  bool is_paused_state() const { return is_loaded && is_paused; }
-  double get_position() const { return current_position; }
-  double get_duration() const { return duration; }
+  bool is_playing_state() const { return state.load()->playing(); }
+  bool is_paused_state() const {
+    auto snap = state.load();
+    return snap->loaded && snap->paused;
+  }
+  // Last reported position, advanced from the monotonic clock while playing
+  double get_position() const { return state.load()->interpolated_position(); }
+  double get_duration() const { return state.load()->duration; }
 };
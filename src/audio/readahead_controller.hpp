@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+
+// Sizes mpv's network buffer to the link. Starts with a modest readahead,
+// doubles it after every underrun and, once the link has proven fast and
+// stable, walks it back down so fast connections do not buffer minutes of
+// audio they will never need. The controller only decides; the player
+// applies the result to cache-secs, demuxer-readahead-secs and
+// demuxer-max-bytes.
+class ReadaheadController {
+public:
+  struct Settings {
+    double readahead_secs;
+    int64_t max_bytes;
+  };
+
+  struct Stats {
+    int stalls = 0;              // underruns this session
+    int64_t throughput = 0;      // bytes/s, smoothed
+    double readahead_secs = 0.0; // current target
+  };
+
+private:
+  static constexpr double MIN_SECS = 10.0;
+  static constexpr double START_SECS = 20.0;
+  static constexpr double MAX_SECS = 300.0;
+  // Stall-free playing time before stepping the readahead down
+  static constexpr double STABLE_SECS = 60.0;
+  // Link speed, as a multiple of the stream bitrate, that counts as fast
+  static constexpr double FAST_LINK = 4.0;
+  static constexpr int64_t MIN_BYTES = 4LL * 1024 * 1024;
+  static constexpr int64_t MAX_BYTES = 256LL * 1024 * 1024;
+  static constexpr int64_t DEFAULT_BITRATE = 320000; // bits/s, when unknown
+
+  double readahead = START_SECS;
+  int64_t bitrate = 0;
+  double stable_for = 0.0;
+  Stats stats;
+
+  Settings settings() const {
+    int64_t bytes_per_sec = (bitrate > 0 ? bitrate : DEFAULT_BITRATE) / 8;
+    // Twice the readahead worth, so seeking back stays in the buffer too
+    int64_t bytes = static_cast<int64_t>(readahead * bytes_per_sec * 2);
+    return {readahead, std::clamp(bytes, MIN_BYTES, MAX_BYTES)};
+  }
+
+public:
+  ReadaheadController() { stats.readahead_secs = readahead; }
+
+  // Limits for the current target, e.g. for a freshly created handle
+  Settings current() const { return settings(); }
+
+  const Stats &get_stats() const { return stats; }
+
+  // Stream bitrate in bits/s as reported by mpv (audio-bitrate)
+  std::optional<Settings> on_bitrate(int64_t bits_per_sec) {
+    if (bits_per_sec <= 0 || bits_per_sec == bitrate) {
+      return std::nullopt;
+    }
+    bitrate = bits_per_sec;
+    return settings();
+  }
+
+  // Playback paused for cache while playing a network stream
+  std::optional<Settings> on_underrun() {
+    stats.stalls++;
+    stable_for = 0.0;
+    if (readahead >= MAX_SECS) {
+      return std::nullopt;
+    }
+    readahead = std::min(readahead * 2, MAX_SECS);
+    stats.readahead_secs = readahead;
+    return settings();
+  }
+
+  // Periodic sample while a network stream plays: measured download speed
+  // (cache-speed, bytes/s) and the time since the previous sample
+  std::optional<Settings> on_sample(int64_t bytes_per_sec, double elapsed_secs) {
+    // Smooth over roughly ten samples; idle samples once the buffer is
+    // full say nothing about the link
+    if (bytes_per_sec > 0) {
+      stats.throughput = stats.throughput == 0
+                             ? bytes_per_sec
+                             : (stats.throughput * 9 + bytes_per_sec) / 10;
+    }
+
+    stable_for += elapsed_secs;
+    int64_t stream_rate = (bitrate > 0 ? bitrate : DEFAULT_BITRATE) / 8;
+    bool fast = stats.throughput >= stream_rate * FAST_LINK;
+    if (stable_for < STABLE_SECS || !fast || readahead <= MIN_SECS) {
+      return std::nullopt;
+    }
+    stable_for = 0.0;
+    readahead = std::max(readahead * 0.75, MIN_SECS);
+    stats.readahead_secs = readahead;
+    return settings();
+  }
+};
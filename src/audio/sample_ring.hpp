@@ -0,0 +1,112 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// Widens captured float samples to the doubles the spectrum code takes,
+// four at a time where the target has SIMD
+inline void convert_samples(const float *in, double *out, size_t count) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  for (; i + 4 <= count; i += 4) {
+    __m128 f = _mm_loadu_ps(in + i);
+    _mm_storeu_pd(out + i, _mm_cvtps_pd(f));
+    _mm_storeu_pd(out + i + 2, _mm_cvtps_pd(_mm_movehl_ps(f, f)));
+  }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  for (; i + 4 <= count; i += 4) {
+    float32x4_t f = vld1q_f32(in + i);
+    vst1q_f64(out + i, vcvt_f64_f32(vget_low_f32(f)));
+    vst1q_f64(out + i + 2, vcvt_high_f64_f32(f));
+  }
+#endif
+  for (; i < count; i++) {
+    out[i] = static_cast<double>(in[i]);
+  }
+}
+
+// Lock-free single-producer/single-consumer ring of interleaved float
+// samples between the capture thread and the visualizer. The producer
+// never blocks or allocates: a write that does not fit is dropped whole
+// (and counted), which keeps channels aligned.
+class SampleRing {
+private:
+  std::unique_ptr<float[]> data;
+  size_t mask;
+
+  // Free-running positions; each is written by one side only
+  alignas(64) std::atomic<size_t> head{0}; // producer
+  alignas(64) std::atomic<size_t> tail{0}; // consumer
+  alignas(64) std::atomic<uint64_t> dropped{0};
+
+  static size_t round_up(size_t n) {
+    size_t capacity = 1;
+    while (capacity < n) {
+      capacity <<= 1;
+    }
+    return capacity;
+  }
+
+public:
+  explicit SampleRing(size_t min_capacity)
+      : data(new float[round_up(min_capacity)]), mask(round_up(min_capacity) - 1) {}
+
+  SampleRing(const SampleRing &) = delete;
+  SampleRing &operator=(const SampleRing &) = delete;
+
+  size_t capacity() const { return mask + 1; }
+
+  // Producer. False (and nothing written) when `count` does not fit.
+  bool write(const float *samples, size_t count) {
+    size_t h = head.load(std::memory_order_relaxed);
+    size_t t = tail.load(std::memory_order_acquire);
+    if (capacity() - (h - t) < count) {
+      dropped.fetch_add(count, std::memory_order_relaxed);
+      return false;
+    }
+    size_t start = h & mask;
+    size_t first = std::min(count, capacity() - start);
+    std::copy(samples, samples + first, data.get() + start);
+    std::copy(samples + first, samples + count, data.get());
+    head.store(h + count, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer
+  size_t available() const {
+    return head.load(std::memory_order_acquire) - tail.load(std::memory_order_relaxed);
+  }
+
+  // Consumer. Moves up to `count` of the oldest samples into `out`,
+  // converted to double on the way.
+  size_t read(double *out, size_t count) {
+    size_t t = tail.load(std::memory_order_relaxed);
+    size_t n = std::min(count, head.load(std::memory_order_acquire) - t);
+    size_t start = t & mask;
+    size_t first = std::min(n, capacity() - start);
+    convert_samples(data.get() + start, out, first);
+    convert_samples(data.get(), out + first, n - first);
+    tail.store(t + n, std::memory_order_release);
+    return n;
+  }
+
+  // Consumer. Discards up to `count` of the oldest samples.
+  size_t skip(size_t count) {
+    size_t t = tail.load(std::memory_order_relaxed);
+    size_t n = std::min(count, head.load(std::memory_order_acquire) - t);
+    tail.store(t + n, std::memory_order_release);
+    return n;
+  }
+
+  // Samples lost to a full ring since construction
+  uint64_t dropped_samples() const { return dropped.load(std::memory_order_relaxed); }
+};
@@ -0,0 +1,235 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// Self-contained spectrum analyzer: log-spaced bars from interleaved
+// samples, for any bar count and sample rate. A Hann-windowed real FFT is
+// computed as a half-size complex FFT (split real/imaginary arrays so the
+// butterflies vectorize) and unpacked; windows, bit reversal, twiddles and
+// the bin range of every bar are tabled up front, so process() does no
+// allocation and no trigonometry. Bars are band power in dB mapped to 0..1.
+class SpectrumAnalyzer {
+private:
+  // Quietest level shown, dB relative to a full-scale sine
+  static constexpr double FLOOR_DB = -60.0;
+
+  int bars;
+  int sample_rate;
+  int channels;
+  size_t fft_size; // real input points, a power of two
+  size_t half;     // complex FFT points
+
+  std::vector<double> input_buffer;   // interleaved, written by the caller
+  std::vector<double> history;        // newest fft_size mono samples
+  std::vector<double> window;         // Hann
+  std::vector<size_t> bit_reverse;    // over `half`
+  std::vector<double> twiddle_re;     // per stage, contiguous per stage
+  std::vector<double> twiddle_im;
+  std::vector<double> unpack_cos;     // real FFT unpacking, k = 0..half
+  std::vector<double> unpack_sin;
+  std::vector<double> re, im;         // FFT work
+  std::vector<size_t> band_start;     // bins [band_start[b], band_start[b + 1])
+  std::vector<double> output_buffer;
+  double power_scale;
+
+  static size_t pick_fft_size(int sample_rate, int bars) {
+    // About 46 ms of audio; twice that for many narrow bars
+    size_t target = static_cast<size_t>(sample_rate) * (bars > 64 ? 92 : 46) / 1000;
+    size_t size = 256;
+    while (size < target) {
+      size <<= 1;
+    }
+    return size;
+  }
+
+  void build_tables(int low_cutoff, int high_cutoff) {
+    const double pi = std::acos(-1.0);
+
+    window.resize(fft_size);
+    for (size_t n = 0; n < fft_size; n++) {
+      window[n] = 0.5 - 0.5 * std::cos(2.0 * pi * n / (fft_size - 1));
+    }
+
+    size_t bits = 0;
+    while ((size_t{1} << bits) < half) {
+      bits++;
+    }
+    bit_reverse.resize(half);
+    for (size_t i = 0; i < half; i++) {
+      size_t r = 0;
+      for (size_t b = 0; b < bits; b++) {
+        r |= ((i >> b) & 1) << (bits - 1 - b);
+      }
+      bit_reverse[i] = r;
+    }
+
+    // Stage with span `len` uses twiddles [len/2 - 1, len - 1)
+    twiddle_re.resize(half);
+    twiddle_im.resize(half);
+    for (size_t len = 2; len <= half; len <<= 1) {
+      for (size_t k = 0; k < len / 2; k++) {
+        double angle = -2.0 * pi * k / len;
+        twiddle_re[len / 2 - 1 + k] = std::cos(angle);
+        twiddle_im[len / 2 - 1 + k] = std::sin(angle);
+      }
+    }
+
+    unpack_cos.resize(half + 1);
+    unpack_sin.resize(half + 1);
+    for (size_t k = 0; k <= half; k++) {
+      double angle = -2.0 * pi * k / fft_size;
+      unpack_cos[k] = std::cos(angle);
+      unpack_sin[k] = std::sin(angle);
+    }
+
+    // Log-spaced edges, at least one bin per bar
+    double nyquist = sample_rate / 2.0;
+    double low = std::clamp<double>(low_cutoff, 1.0, nyquist);
+    double high = std::clamp<double>(high_cutoff, low * 2.0, nyquist);
+    double bin_hz = static_cast<double>(sample_rate) / fft_size;
+    band_start.resize(bars + 1);
+    for (int b = 0; b <= bars; b++) {
+      double freq = low * std::pow(high / low, static_cast<double>(b) / bars);
+      size_t bin = static_cast<size_t>(std::lround(freq / bin_hz));
+      if (b > 0) {
+        bin = std::max(bin, band_start[b - 1] + 1);
+      }
+      band_start[b] = std::clamp<size_t>(bin, 1, half);
+    }
+
+    // Peak bin of a full-scale sine under the window: amplitude * sum / 2
+    double window_sum = 0.0;
+    for (double w : window) {
+      window_sum += w;
+    }
+    power_scale = 1.0 / ((window_sum / 2.0) * (window_sum / 2.0));
+  }
+
+  // Butterflies of one stage; `w` points at its twiddles
+  void fft_stage(size_t len, const double *w_re, const double *w_im) {
+    size_t span = len / 2;
+    for (size_t start = 0; start < half; start += len) {
+      double *a_re = re.data() + start, *a_im = im.data() + start;
+      double *b_re = a_re + span, *b_im = a_im + span;
+      size_t k = 0;
+#if defined(__SSE2__)
+      for (; k + 2 <= span; k += 2) {
+        __m128d wr = _mm_loadu_pd(w_re + k), wi = _mm_loadu_pd(w_im + k);
+        __m128d br = _mm_loadu_pd(b_re + k), bi = _mm_loadu_pd(b_im + k);
+        __m128d tr = _mm_sub_pd(_mm_mul_pd(br, wr), _mm_mul_pd(bi, wi));
+        __m128d ti = _mm_add_pd(_mm_mul_pd(br, wi), _mm_mul_pd(bi, wr));
+        __m128d ar = _mm_loadu_pd(a_re + k), ai = _mm_loadu_pd(a_im + k);
+        _mm_storeu_pd(a_re + k, _mm_add_pd(ar, tr));
+        _mm_storeu_pd(a_im + k, _mm_add_pd(ai, ti));
+        _mm_storeu_pd(b_re + k, _mm_sub_pd(ar, tr));
+        _mm_storeu_pd(b_im + k, _mm_sub_pd(ai, ti));
+      }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+      for (; k + 2 <= span; k += 2) {
+        float64x2_t wr = vld1q_f64(w_re + k), wi = vld1q_f64(w_im + k);
+        float64x2_t br = vld1q_f64(b_re + k), bi = vld1q_f64(b_im + k);
+        float64x2_t tr = vsubq_f64(vmulq_f64(br, wr), vmulq_f64(bi, wi));
+        float64x2_t ti = vaddq_f64(vmulq_f64(br, wi), vmulq_f64(bi, wr));
+        float64x2_t ar = vld1q_f64(a_re + k), ai = vld1q_f64(a_im + k);
+        vst1q_f64(a_re + k, vaddq_f64(ar, tr));
+        vst1q_f64(a_im + k, vaddq_f64(ai, ti));
+        vst1q_f64(b_re + k, vsubq_f64(ar, tr));
+        vst1q_f64(b_im + k, vsubq_f64(ai, ti));
+      }
+#endif
+      for (; k < span; k++) {
+        double tr = b_re[k] * w_re[k] - b_im[k] * w_im[k];
+        double ti = b_re[k] * w_im[k] + b_im[k] * w_re[k];
+        b_re[k] = a_re[k] - tr;
+        b_im[k] = a_im[k] - ti;
+        a_re[k] += tr;
+        a_im[k] += ti;
+      }
+    }
+  }
+
+  // Power of real-input bin k (0 < k < half) from the packed FFT
+  double bin_power(size_t k) const {
+    size_t m = half - k;
+    // Even and odd sample spectra
+    double even_re = (re[k] + re[m]) * 0.5;
+    double even_im = (im[k] - im[m]) * 0.5;
+    double odd_re = (im[k] + im[m]) * 0.5;
+    double odd_im = (re[m] - re[k]) * 0.5;
+    double x_re = even_re + unpack_cos[k] * odd_re - unpack_sin[k] * odd_im;
+    double x_im = even_im + unpack_cos[k] * odd_im + unpack_sin[k] * odd_re;
+    return x_re * x_re + x_im * x_im;
+  }
+
+public:
+  SpectrumAnalyzer(int bars, int sample_rate, int channels, int low_cutoff = 50,
+                   int high_cutoff = 10000)
+      : bars(bars), sample_rate(sample_rate), channels(channels),
+        fft_size(pick_fft_size(sample_rate, bars)), half(fft_size / 2) {
+    if (bars < 1 || sample_rate < 1000 || channels < 1) {
+      throw std::invalid_argument("spectrum analyzer: bad bar count, rate or channels");
+    }
+    input_buffer.resize(fft_size * channels);
+    history.assign(fft_size, 0.0);
+    re.resize(half);
+    im.resize(half);
+    output_buffer.resize(bars);
+    build_tables(low_cutoff, high_cutoff);
+  }
+
+  // Where the caller puts new interleaved samples, up to input_capacity()
+  double *input() { return input_buffer.data(); }
+  size_t input_capacity() const { return input_buffer.size(); }
+
+  int get_num_bars() const { return bars; }
+  size_t get_fft_size() const { return fft_size; }
+
+  // Shifts the first `count` samples of input() into the analysis window
+  // and returns one level (0..1) per bar, valid until the next call
+  const std::vector<double> &process(size_t count) {
+    size_t frames = std::min(count, input_buffer.size()) / channels;
+
+    // Mono history of the newest fft_size frames
+    std::move(history.begin() + frames, history.end(), history.begin());
+    double *tail = history.data() + (fft_size - frames);
+    const double *in = input_buffer.data();
+    double gain = 1.0 / channels;
+    for (size_t f = 0; f < frames; f++) {
+      double sum = 0.0;
+      for (int c = 0; c < channels; c++) {
+        sum += in[f * channels + c];
+      }
+      tail[f] = sum * gain;
+    }
+
+    // Pack even samples as real, odd as imaginary, in bit-reversed order
+    for (size_t n = 0; n < half; n++) {
+      size_t r = bit_reverse[n];
+      re[r] = history[2 * n] * window[2 * n];
+      im[r] = history[2 * n + 1] * window[2 * n + 1];
+    }
+    for (size_t len = 2; len <= half; len <<= 1) {
+      fft_stage(len, twiddle_re.data() + len / 2 - 1, twiddle_im.data() + len / 2 - 1);
+    }
+
+    for (int b = 0; b < bars; b++) {
+      double power = 0.0;
+      for (size_t k = band_start[b]; k < std::max(band_start[b + 1], band_start[b] + 1); k++) {
+        power += k < half ? bin_power(k) : 0.0;
+      }
+      double db = 10.0 * std::log10(power * power_scale + 1e-12);
+      output_buffer[b] = std::clamp((db - FLOOR_DB) / -FLOOR_DB, 0.0, 1.0);
+    }
+    return output_buffer;
+  }
+};
@@ -1,33 +1,44 @@
 #pragma once
 
+#ifdef WITH_CAVA
 #include "../cava/cavacore.h"
+#else
+#include "spectrum_analyzer.hpp"
+#endif
+#include <algorithm>
 #include <memory>
 #include <stdexcept>
 #include <vector>
 
+// Spectrum bars for the visualizer. Uses the built-in SpectrumAnalyzer
+// unless built WITH_CAVA, in which case cavacore (and FFTW) do the work.
 class AudioVisualizer {
 private:
-    struct cava_plan* plan;
-    std::vector<double> input_buffer;
-    std::vector<double> output_buffer;
-    static constexpr int BARS = 16;  // Number of frequency bands (matches NUM_BARS in main)
-    static constexpr int SAMPLE_RATE = 44100;
-    static constexpr int CHANNELS = 2;
     static constexpr double NOISE_REDUCTION = 0.77;
     static constexpr int LOW_CUTOFF = 50;
     static constexpr int HIGH_CUTOFF = 10000;
 
+    int bars;
+#ifdef WITH_CAVA
+    struct cava_plan* plan;
+    std::vector<double> input_buffer;
+    std::vector<double> output_buffer;
+#else
+    SpectrumAnalyzer analyzer;
+#endif
+
 public:
-    AudioVisualizer() {
+#ifdef WITH_CAVA
+    AudioVisualizer(int bars, int sample_rate, int channels) : bars(bars) {
         // Initialize cava
-        plan = cava_init(BARS, SAMPLE_RATE, CHANNELS, 1, 
+        plan = cava_init(bars, sample_rate, channels, 1,
                         NOISE_REDUCTION, LOW_CUTOFF, HIGH_CUTOFF);
         if (plan->status < 0) {
             throw std::runtime_error(plan->error_message);
         }
 
         input_buffer.resize(plan->input_buffer_size);
-        output_buffer.resize(BARS * CHANNELS);
+        output_buffer.resize(bars * channels);
     }
 
     ~AudioVisualizer() {
@@ -37,23 +48,34 @@ public:
         }
     }
 
-    // Process audio data and return visualization values
-    std::vector<double> process(const std::vector<double>& audio_data) {
-        if (audio_data.empty()) {
-            return std::vector<double>(BARS * CHANNELS, 0.0);
-        }
+    AudioVisualizer(const AudioVisualizer&) = delete;
+    AudioVisualizer& operator=(const AudioVisualizer&) = delete;
 
-        // Copy input data
-        size_t samples_to_process = std::min(audio_data.size(), input_buffer.size());
-        std::copy(audio_data.begin(), audio_data.begin() + samples_to_process, 
-                 input_buffer.begin());
+    // Where the caller puts new interleaved samples for process(), up to
+    // input_capacity() of them
+    double* input() { return input_buffer.data(); }
+    size_t input_capacity() const { return input_buffer.size(); }
 
-        // Process through cava
-        cava_execute(input_buffer.data(), samples_to_process, 
+    // Runs cava over the first `count` samples of input() and returns the
+    // bar values (left channel's bars, then the right's), valid until the
+    // next call
+    const std::vector<double>& process(size_t count) {
+        cava_execute(input_buffer.data(), std::min(count, input_buffer.size()),
                     output_buffer.data(), plan);
-
         return output_buffer;
     }
+#else
+    AudioVisualizer(int bars, int sample_rate, int channels)
+        : bars(bars), analyzer(bars, sample_rate, channels, LOW_CUTOFF, HIGH_CUTOFF) {}
+
+    double* input() { return analyzer.input(); }
+    size_t input_capacity() const { return analyzer.input_capacity(); }
+
+    // One level per bar, channels mixed down
+    const std::vector<double>& process(size_t count) {
+        return analyzer.process(count);
+    }
+#endif
 
-    int get_num_bars() const { return BARS; }
+    int get_num_bars() const { return bars; }
 };
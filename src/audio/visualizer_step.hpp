@@ -0,0 +1,74 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "bar_smoother.hpp"
+#include "sample_ring.hpp"
+#include "visualizer.hpp"
+
+// The work of one visualizer tick, shared by the player's visualizer
+// thread and the benchmark: analyze() turns the newest window in the ring
+// into bar targets, advance() moves the bars toward them. Split in two so
+// the benchmark can time the spectrum and the motion apart.
+class VisualizerStep {
+public:
+  // Gain on the spectrum levels before clipping to 0..1
+  static constexpr double SENSITIVITY = 1.2;
+  // Capture fragments come every ~12 ms; a tick that falls between two
+  // keeps the last targets, a longer gap is silence
+  static constexpr double SILENCE_SECS = 0.12;
+
+private:
+  size_t window = 0; // samples per analysis, whole frames
+  BarSmoother smoother{0};
+  std::vector<double> targets;
+  double since_samples = 0.0;
+  size_t last_count = 0;
+
+public:
+  size_t bars() const { return targets.size(); }
+
+  // Sizes everything for `visualizer`'s bar count and input; call again
+  // whenever it is rebuilt with another count
+  void configure(const AudioVisualizer &visualizer, int channels) {
+    window = visualizer.input_capacity() - visualizer.input_capacity() % channels;
+    size_t count = static_cast<size_t>(visualizer.get_num_bars());
+    if (count != targets.size()) {
+      smoother = BarSmoother(count);
+      targets.assign(count, 0.0);
+    }
+  }
+
+  // Runs the spectrum over the newest window in `ring`, `dt` seconds
+  // after the last tick. Returns the samples analyzed, 0 for none.
+  size_t analyze(SampleRing &ring, AudioVisualizer &visualizer, double dt) {
+    if (ring.available() > window) {
+      ring.skip(ring.available() - window); // keep the newest window
+    }
+    last_count = ring.read(visualizer.input(), window);
+    if (last_count > 0) {
+      since_samples = 0.0;
+      const auto &out = visualizer.process(last_count);
+      size_t count = targets.size();
+      for (size_t i = 0; i < count; i++) {
+        // cava lays out the left channel's bars, then the right's; the
+        // built-in analyzer mixes down itself
+        double value = out.size() >= count * 2 ? (out[i] + out[i + count]) / 2.0 : out[i];
+        targets[i] = std::clamp(value * SENSITIVITY, 0.0, 1.0);
+      }
+    } else if ((since_samples += dt) > SILENCE_SECS) {
+      std::fill(targets.begin(), targets.end(), 0.0);
+    }
+    return last_count;
+  }
+
+  // Bar levels (0..1) after `dt` seconds of motion, valid until the next
+  // call
+  const std::vector<double> &advance(double dt) { return smoother.update(targets, dt); }
+
+  // No samples on the last tick and every bar down: nothing will move
+  // until audio arrives
+  bool settled() const { return last_count == 0 && smoother.at_rest(); }
+};
@@ -100,7 +100,7 @@ inline std::string get_cache_dir() {
     // Linux/Unix - XDG Base Directory Specification
     const char* xdg_cache = getenv("XDG_CACHE_HOME");
     if (xdg_cache) {
-        return std::string(xdg_cache) + "tuisic";
+        return std::string(xdg_cache) + "/tuisic";
     }
     
     const char* home = getenv("HOME");
@@ -136,6 +136,20 @@ inline std::string get_music_dir() {
 #endif
 }
 
+// Control socket of the playback daemon (POSIX only). Per user, in the
+// runtime directory when there is one.
+inline std::string get_socket_path() {
+    const char* runtime = getenv("XDG_RUNTIME_DIR");
+    if (runtime) {
+        return std::string(runtime) + "/tuisic.sock";
+    }
+#ifdef _WIN32
+    return ".\\tuisic.sock";
+#else
+    return "/tmp/tuisic-" + std::to_string(getuid()) + ".sock";
+#endif
+}
+
 // Ensure directory exists
 inline void ensure_directory_exists(const std::string& path) {
     try {
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Gives the playing stream priority over background transfers. A probe
+// reports how many seconds of audio the player has buffered ahead while
+// streaming (negative when nothing streams) and how much it buffers at
+// most. Below the low watermark the arbiter throttles: background
+// transfers share a small fixed budget until the buffer recovers past the
+// high watermark.
+class BandwidthArbiter {
+public:
+  struct Buffer {
+    double ahead;  // seconds buffered, negative when nothing streams
+    double target; // player's readahead target in seconds, 0 = unknown
+  };
+
+  // Watermarks for a readahead `target` (0 = unknown). The release point
+  // is three times the low watermark, but never beyond what the player
+  // will ever buffer: the buffer plateaus at its readahead target, so a
+  // higher release point would keep transfers throttled until playback
+  // stops.
+  static std::pair<double, double> watermarks(double low, double target) {
+    double high = low * 3;
+    if (target > 0) {
+      high = std::min(high, std::max(target - RELEASE_MARGIN_SECS, 1.0));
+      low = std::min(low, high / 2);
+    }
+    return {low, high};
+  }
+
+  // Throttle state after a probe reading, given the current one
+  static bool next_state(bool throttled, const Buffer &buffer, double low_watermark) {
+    if (buffer.ahead < 0) {
+      return false; // nothing streaming
+    }
+    auto [low, high] = watermarks(low_watermark, buffer.target);
+    if (buffer.ahead < low) {
+      return true;
+    }
+    return buffer.ahead >= high ? false : throttled;
+  }
+
+private:
+  std::function<Buffer()> probe;
+  double low_secs;
+  int64_t throttled_bytes_per_sec;
+
+  std::atomic_bool throttled{false};
+  std::atomic<int> transfers{0};
+
+  std::mutex listener_mutex;
+  std::vector<std::function<void(bool)>> listeners;
+
+  std::thread worker;
+  std::mutex wake_mutex;
+  std::condition_variable wake;
+  std::atomic_bool running{false};
+
+  static constexpr std::chrono::milliseconds SAMPLE_INTERVAL{500};
+  // How far below the readahead target the buffer counts as recovered
+  static constexpr double RELEASE_MARGIN_SECS = 2.0;
+
+  void run() {
+    while (running) {
+      {
+        std::unique_lock<std::mutex> lock(wake_mutex);
+        wake.wait_for(lock, SAMPLE_INTERVAL, [this] { return !running; });
+      }
+      if (!running) {
+        break;
+      }
+
+      bool next = next_state(throttled, probe ? probe() : Buffer{-1.0, 0.0}, low_secs);
+
+      if (next != throttled.exchange(next)) {
+        std::vector<std::function<void(bool)>> targets;
+        {
+          std::lock_guard<std::mutex> lock(listener_mutex);
+          targets = listeners;
+        }
+        for (const auto &listener : targets) {
+          listener(next);
+        }
+      }
+    }
+  }
+
+public:
+  // Hysteresis: throttle below low_watermark seconds buffered, release
+  // well above it (see watermarks())
+  BandwidthArbiter(std::function<Buffer()> buffered_ahead, double low_watermark,
+                   int throttle_kbps)
+      : probe(std::move(buffered_ahead)), low_secs(std::max(low_watermark, 1.0)),
+        throttled_bytes_per_sec(static_cast<int64_t>(std::max(throttle_kbps, 1)) * 1024) {}
+
+  ~BandwidthArbiter() { stop(); }
+
+  BandwidthArbiter(const BandwidthArbiter &) = delete;
+  BandwidthArbiter &operator=(const BandwidthArbiter &) = delete;
+
+  void start() {
+    if (running.exchange(true)) {
+      return;
+    }
+    worker = std::thread([this] { run(); });
+  }
+
+  void stop() {
+    if (!running.exchange(false)) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(wake_mutex);
+    }
+    wake.notify_one();
+    if (worker.joinable()) {
+      worker.join();
+    }
+  }
+
+  // Called from the arbiter thread whenever throttling turns on or off.
+  // For transfers that cannot be rate limited in-process.
+  void add_listener(std::function<void(bool)> listener) {
+    std::lock_guard<std::mutex> lock(listener_mutex);
+    listeners.push_back(std::move(listener));
+  }
+
+  bool is_throttled() const { return throttled; }
+
+  // Background transfers register while they run so the budget is split
+  void register_transfer() { transfers++; }
+  void unregister_transfer() { transfers--; }
+
+  // Receive limit for one registered transfer in bytes/s; 0 = unlimited
+  int64_t transfer_limit() const {
+    if (!throttled) {
+      return 0;
+    }
+    return std::max<int64_t>(throttled_bytes_per_sec / std::max(transfers.load(), 1), 1024);
+  }
+};
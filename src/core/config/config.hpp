@@ -27,6 +27,11 @@ private:
                         allocator);
     downloads.AddMember("format", "mp3", allocator);
     downloads.AddMember("quality", "best", allocator);
+    downloads.AddMember("workers", 2, allocator);
+    downloads.AddMember("connections", 4, allocator);
+    downloads.AddMember("transcode", false, allocator);
+    downloads.AddMember("throttle_kbps", 64, allocator);
+    downloads.AddMember("throttle_below_secs", 10, allocator);
     config.AddMember("downloads", downloads, allocator);
 
     /* // Downloads section */
@@ -42,6 +47,9 @@ private:
     player.AddMember("volume", 100, allocator);
     player.AddMember("subtitle_enabled", true, allocator);
     player.AddMember("repeat_enabled", false, allocator);
+    player.AddMember("max_bitrate_kbps", 320, allocator);
+    player.AddMember("hot_standby", false, allocator);
+    player.AddMember("standby_min_free_mb", 512, allocator);
     
     // MPV-specific settings
     rapidjson::Value mpv_options(rapidjson::kObjectType);
@@ -69,6 +77,10 @@ private:
     ui.AddMember("theme", "dark", allocator);
     ui.AddMember("show_notifications", true, allocator);
     ui.AddMember("notification_timeout", 3000, allocator);
+    ui.AddMember("max_fps", 30, allocator);
+    ui.AddMember("visualizer_fps", 30, allocator);
+    ui.AddMember("visualizer_bars", 0, allocator);
+    ui.AddMember("visualizer_style", "blocks", allocator);
     config.AddMember("ui", ui, allocator);
 
     // Cache section
@@ -195,16 +207,84 @@ public:
     return get_string_value("downloads", "format", "mp3");
   }
 
+  // Number of downloads run in parallel
+  int get_download_workers() const {
+    return get_int_value("downloads", "workers", 2);
+  }
+
+  // Parallel range requests per direct-URL download
+  int get_download_connections() const {
+    return get_int_value("downloads", "connections", 4);
+  }
+
+  // Re-encode direct-URL downloads to the configured format instead of
+  // keeping the source codec
+  bool get_download_transcode() const {
+    return get_bool_value("downloads", "transcode", false);
+  }
+
+  // Background transfer budget while the playing stream's buffer is low
+  int get_download_throttle_kbps() const {
+    return get_int_value("downloads", "throttle_kbps", 64);
+  }
+
+  // Seconds buffered ahead below which background transfers are throttled
+  int get_throttle_below_secs() const {
+    return get_int_value("downloads", "throttle_below_secs", 10);
+  }
+
   bool get_subtitle_enabled() const {
     return get_bool_value("player", "subtitle_enabled", false);
   }
 
   int get_volume() const { return get_int_value("player", "volume", 100); }
 
+  // Highest stream quality to request; lowered automatically on stalls
+  int get_max_bitrate_kbps() const {
+    return get_int_value("player", "max_bitrate_kbps", 320);
+  }
+
+  // Second mpv instance preloading the next track for instant skips
+  bool get_hot_standby() const {
+    return get_bool_value("player", "hot_standby", false);
+  }
+
+  // Free memory below which the standby instance is dropped
+  int get_standby_min_free_mb() const {
+    return get_int_value("player", "standby_min_free_mb", 512);
+  }
+
   bool get_notifications_enabled() const {
     return get_bool_value("ui", "show_notifications", true);
   }
 
+  // Upper bound on UI redraws per second
+  int get_max_fps() const { return get_int_value("ui", "max_fps", 30); }
+
+  // Rate at which the visualizer computes bar frames
+  int get_visualizer_fps() const { return get_int_value("ui", "visualizer_fps", 30); }
+
+  // Number of spectrum bars the visualizer draws; 0 fits them to the panel
+  int get_visualizer_bars() const { return get_int_value("ui", "visualizer_bars", 0); }
+
+  // "blocks" (eighth blocks) or "braille" (two bars per column)
+  std::string get_visualizer_style() const {
+    return get_string_value("ui", "visualizer_style", "blocks");
+  }
+
+  // Audio cache settings getters
+  bool get_cache_enabled() const {
+    return get_bool_value("cache", "enabled", true);
+  }
+
+  int get_cache_max_size_mb() const {
+    return get_int_value("cache", "max_size_mb", 100);
+  }
+
+  std::string get_cache_path() const {
+    return get_string_value("cache", "path", paths::get_cache_dir());
+  }
+
   // MPV settings getters
   std::string get_mpv_option(const std::string& option, const std::string& default_value = "") const {
     std::lock_guard<std::mutex> lock(config_mutex);
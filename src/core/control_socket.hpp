@@ -0,0 +1,512 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <poll.h>
+#include <string>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+
+// Control protocol of the playback daemon: a Unix stream socket carrying
+// one command per line (the same text `--cmd` takes, e.g. "play jazz",
+// "status") and one JSON response line per command. Connections stay
+// open for as many commands as the client sends.
+//
+// "subscribe [position_interval_ms]" turns the connection into a stream
+// of playback event lines after its response, until the client sends
+// "unsubscribe" (answered with one more response line) or hangs up.
+namespace control {
+
+// Longest accepted request line; anything beyond is a protocol error
+constexpr size_t MAX_LINE = 64 * 1024;
+
+// Reads one '\n'-terminated line, keeping bytes after it in `pending`.
+// False on EOF, error or an overlong line.
+inline bool read_line(int fd, std::string &pending, std::string &line) {
+  for (;;) {
+    auto newline = pending.find('\n');
+    if (newline != std::string::npos) {
+      line = pending.substr(0, newline);
+      pending.erase(0, newline + 1);
+      return true;
+    }
+    if (pending.size() > MAX_LINE) {
+      return false;
+    }
+    char buf[4096];
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    pending.append(buf, n);
+  }
+}
+
+inline bool write_all(int fd, const std::string &data) {
+  size_t done = 0;
+  while (done < data.size()) {
+    ssize_t n = send(fd, data.data() + done, data.size() - done, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    done += n;
+  }
+  return true;
+}
+
+inline bool make_address(const std::string &path, sockaddr_un &addr) {
+  if (path.size() >= sizeof(addr.sun_path)) {
+    return false;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+  return true;
+}
+
+// Serves commands to any number of clients, one thread per connection.
+// Each connection's commands run in order; commands from different
+// connections run concurrently, so `execute` must be thread-safe. A slow
+// "play" on one connection never holds up "status" on another.
+class Server {
+public:
+  using Executor = std::function<std::string(const std::string &)>;
+  // Starts delivering event lines to `emit` for the arguments of
+  // "subscribe"; returns the function that stops them
+  using Subscriber = std::function<std::function<void()>(
+      const std::string &, std::function<void(const std::string &)>)>;
+
+private:
+  struct Connection {
+    int fd;
+    std::thread thread;
+    std::atomic_bool done{false};
+  };
+
+  // Event lines waiting for a subscribed connection's thread. Filled from
+  // the publisher's thread, which must never block on a slow client: past
+  // MAX_QUEUED lines the oldest are dropped.
+  struct Outbox {
+    static constexpr size_t MAX_QUEUED = 1024;
+    std::mutex outbox_mutex;
+    std::deque<std::string> lines;
+    int wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+    ~Outbox() {
+      if (wake_fd >= 0) {
+        close(wake_fd);
+      }
+    }
+
+    void push(const std::string &line) {
+      {
+        std::lock_guard<std::mutex> lock(outbox_mutex);
+        if (lines.size() >= MAX_QUEUED) {
+          lines.pop_front();
+        }
+        lines.push_back(line);
+      }
+      uint64_t one = 1;
+      ssize_t ignored = write(wake_fd, &one, sizeof(one));
+      (void)ignored;
+    }
+
+    std::deque<std::string> take() {
+      uint64_t count;
+      ssize_t ignored = read(wake_fd, &count, sizeof(count));
+      (void)ignored;
+      std::lock_guard<std::mutex> lock(outbox_mutex);
+      return std::exchange(lines, {});
+    }
+  };
+
+  std::string path;
+  Executor execute;
+  Subscriber subscribe;
+  std::function<void()> on_quit;
+
+  int listen_fd = -1;
+  std::thread acceptor;
+  std::atomic_bool running{false};
+  std::mutex connection_mutex;
+  std::list<std::unique_ptr<Connection>> connections;
+
+  void serve(Connection &conn) {
+    std::string pending;
+    std::string line;
+    while (running && read_line(conn.fd, pending, line)) {
+      if (!line.empty() && line.back() == '\r') {
+        line.pop_back();
+      }
+      if (line.empty()) {
+        continue;
+      }
+      if (subscribe && (line == "subscribe" || line.rfind("subscribe ", 0) == 0)) {
+        if (!stream_events(conn, line.substr(std::min<size_t>(line.size(), 10)), pending)) {
+          break;
+        }
+        continue;
+      }
+      std::string response;
+      if (line == "quit" && on_quit) {
+        response = R"({"status":"success","message":"Daemon stopping"})";
+      } else {
+        response = execute(line);
+      }
+      if (!write_all(conn.fd, response + "\n")) {
+        break;
+      }
+      if (line == "quit" && on_quit) {
+        on_quit();
+        break;
+      }
+    }
+    conn.done = true;
+  }
+
+  // Forwards events to the connection until "unsubscribe" (true) or the
+  // client hangs up or the server stops (false)
+  bool stream_events(Connection &conn, const std::string &args, std::string &pending) {
+    auto outbox = std::make_shared<Outbox>();
+    if (outbox->wake_fd < 0 ||
+        !write_all(conn.fd, R"({"success":true,"message":"Subscribed"})" "\n")) {
+      return false;
+    }
+    // The outbox outlives the subscription: events already being published
+    // may still arrive after cancel()
+    auto cancel = subscribe(args, [outbox](const std::string &line) { outbox->push(line); });
+
+    bool unsubscribed = false;
+    bool open = true;
+    while (running && open && !unsubscribed) {
+      pollfd fds[2] = {{conn.fd, POLLIN, 0}, {outbox->wake_fd, POLLIN, 0}};
+      if (poll(fds, 2, 250) <= 0) {
+        continue;
+      }
+      if (fds[1].revents & POLLIN) {
+        for (const auto &line : outbox->take()) {
+          if (!write_all(conn.fd, line + "\n")) {
+            open = false;
+            break;
+          }
+        }
+      }
+      if (open && (fds[0].revents & (POLLIN | POLLHUP | POLLERR))) {
+        // Only "unsubscribe" is accepted while streaming
+        char buf[256];
+        ssize_t n = read(conn.fd, buf, sizeof(buf));
+        if (n <= 0) {
+          open = false;
+          break;
+        }
+        pending.append(buf, n);
+        size_t newline;
+        while ((newline = pending.find('\n')) != std::string::npos) {
+          std::string request = pending.substr(0, newline);
+          pending.erase(0, newline + 1);
+          if (!request.empty() && request.back() == '\r') {
+            request.pop_back();
+          }
+          if (request == "unsubscribe") {
+            unsubscribed = true;
+            break;
+          }
+        }
+        if (pending.size() > MAX_LINE) {
+          open = false;
+        }
+      }
+    }
+    cancel();
+    return unsubscribed && write_all(conn.fd, R"({"success":true,"message":"Unsubscribed"})" "\n");
+  }
+
+  // Joins connections that have hung up. Caller holds connection_mutex.
+  void reap() {
+    for (auto it = connections.begin(); it != connections.end();) {
+      if ((*it)->done) {
+        (*it)->thread.join();
+        close((*it)->fd);
+        it = connections.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  void accept_loop() {
+    while (running) {
+      pollfd pfd{listen_fd, POLLIN, 0};
+      if (poll(&pfd, 1, 250) <= 0) {
+        continue;
+      }
+      // Close-on-exec, so yt-dlp and other children never inherit a client
+      int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+      if (fd < 0) {
+        continue;
+      }
+      std::lock_guard<std::mutex> lock(connection_mutex);
+      reap();
+      auto conn = std::make_unique<Connection>();
+      conn->fd = fd;
+      Connection *raw = conn.get();
+      conn->thread = std::thread([this, raw] { serve(*raw); });
+      connections.push_back(std::move(conn));
+    }
+  }
+
+public:
+  Server(std::string socket_path, Executor executor)
+      : path(std::move(socket_path)), execute(std::move(executor)) {}
+
+  ~Server() { stop(); }
+
+  Server(const Server &) = delete;
+  Server &operator=(const Server &) = delete;
+
+  // Lets clients stop a headless daemon with "quit". Set before start();
+  // runs on a connection thread, so it must not call stop() itself.
+  void set_quit_callback(std::function<void()> callback) { on_quit = std::move(callback); }
+
+  // Enables "subscribe". Set before start().
+  void set_subscriber(Subscriber subscriber) { subscribe = std::move(subscriber); }
+
+  // False when another daemon already serves the socket or it cannot be
+  // created. A socket file left behind by a crash is replaced.
+  bool start() {
+    sockaddr_un addr;
+    if (running || !make_address(path, addr)) {
+      return false;
+    }
+
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    bool live = probe >= 0 && connect(probe, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0;
+    if (probe >= 0) {
+      close(probe);
+    }
+    if (live) {
+      return false;
+    }
+    unlink(path.c_str());
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+      return false;
+    }
+    // Owner only: the socket controls playback and downloads
+    mode_t old_mask = umask(077);
+    bool bound = bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0;
+    umask(old_mask);
+    if (!bound || listen(listen_fd, 16) != 0) {
+      close(listen_fd);
+      listen_fd = -1;
+      return false;
+    }
+
+    running = true;
+    acceptor = std::thread([this] { accept_loop(); });
+    return true;
+  }
+
+  void stop() {
+    if (!running.exchange(false)) {
+      return;
+    }
+    if (acceptor.joinable()) {
+      acceptor.join();
+    }
+    close(listen_fd);
+    listen_fd = -1;
+    unlink(path.c_str());
+
+    std::lock_guard<std::mutex> lock(connection_mutex);
+    for (auto &conn : connections) {
+      shutdown(conn->fd, SHUT_RDWR); // unblocks its read
+    }
+    for (auto &conn : connections) {
+      conn->thread.join();
+      close(conn->fd);
+    }
+    connections.clear();
+  }
+};
+
+// Connection to a running daemon
+class Client {
+private:
+  int fd = -1;
+  std::string pending;
+
+public:
+  Client() = default;
+  ~Client() { disconnect(); }
+
+  Client(const Client &) = delete;
+  Client &operator=(const Client &) = delete;
+
+  bool connect(const std::string &path) {
+    disconnect();
+    sockaddr_un addr;
+    if (!make_address(path, addr)) {
+      return false;
+    }
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+      return false;
+    }
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+      disconnect();
+      return false;
+    }
+    return true;
+  }
+
+  bool connected() const { return fd >= 0; }
+
+  void disconnect() {
+    if (fd >= 0) {
+      close(fd);
+      fd = -1;
+    }
+    pending.clear();
+  }
+
+  // One command, one response line; nullopt once the daemon is gone
+  std::optional<std::string> request(const std::string &command) {
+    if (fd < 0 || !write_all(fd, command + "\n")) {
+      disconnect();
+      return std::nullopt;
+    }
+    auto line = read_response();
+    if (!line) {
+      disconnect();
+    }
+    return line;
+  }
+
+  // Next line from the daemon, e.g. an event after "subscribe"
+  std::optional<std::string> read_response() {
+    std::string line;
+    if (fd < 0 || !read_line(fd, pending, line)) {
+      return std::nullopt;
+    }
+    return line;
+  }
+
+  int native_handle() const { return fd; }
+};
+
+// A "subscribe" connection to a running daemon, delivering each event line
+// to a callback from its own thread
+class EventStream {
+private:
+  Client client;
+  int fd = -1;
+  std::thread reader;
+
+public:
+  EventStream() = default;
+  ~EventStream() { stop(); }
+
+  EventStream(const EventStream &) = delete;
+  EventStream &operator=(const EventStream &) = delete;
+
+  bool start(const std::string &path, const std::string &args,
+             std::function<void(const std::string &)> on_event) {
+    stop();
+    std::string command = args.empty() ? "subscribe" : "subscribe " + args;
+    auto ack = client.connect(path) ? client.request(command) : std::nullopt;
+    if (!ack || ack->find("\"success\":true") == std::string::npos) {
+      client.disconnect();
+      return false;
+    }
+    fd = client.native_handle();
+    reader = std::thread([this, on_event = std::move(on_event)] {
+      while (auto line = client.read_response()) {
+        on_event(*line);
+      }
+    });
+    return true;
+  }
+
+  void stop() {
+    if (reader.joinable()) {
+      shutdown(fd, SHUT_RDWR); // unblocks the reader
+      reader.join();
+    }
+    client.disconnect();
+    fd = -1;
+  }
+};
+
+// This binary, for re-executing it as the daemon; argv[0] may be a bare
+// name found through PATH
+inline std::string executable_path(const char *argv0) {
+  char buf[4096];
+  ssize_t n = readlink("/proc/self/exe", buf, sizeof(buf) - 1);
+  if (n > 0) {
+    return std::string(buf, n);
+  }
+  return argv0;
+}
+
+// Starts `program --server` detached from this process (double fork, own
+// session, no terminal) and waits up to `timeout` for its socket
+inline bool spawn_daemon(const std::string &program, const std::string &path,
+                         std::chrono::milliseconds timeout = std::chrono::seconds(5)) {
+  pid_t pid = fork();
+  if (pid < 0) {
+    return false;
+  }
+  if (pid == 0) {
+    setsid();
+    if (fork() != 0) {
+      _exit(0);
+    }
+    int null_fd = open("/dev/null", O_RDWR);
+    if (null_fd >= 0) {
+      dup2(null_fd, STDIN_FILENO);
+      dup2(null_fd, STDOUT_FILENO);
+      dup2(null_fd, STDERR_FILENO);
+      if (null_fd > STDERR_FILENO) {
+        close(null_fd);
+      }
+    }
+    execlp(program.c_str(), program.c_str(), "--server", static_cast<char *>(nullptr));
+    _exit(127);
+  }
+  waitpid(pid, nullptr, 0);
+
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  Client client;
+  while (std::chrono::steady_clock::now() < deadline) {
+    if (client.connect(path)) {
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+  return false;
+}
+
+} // namespace control
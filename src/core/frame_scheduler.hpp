@@ -0,0 +1,128 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Merges redraw requests coming from the player, visualizer and input
+// handlers into frames, posted at most max_fps times per second.
+//
+// State that changes with time alone (the interpolated playback position)
+// is watched through a probe: a cheap function returning a value that only
+// changes when the visible output would. A frame is posted only when a
+// redraw was requested or the probe value moved since the last frame.
+class FrameScheduler {
+private:
+  std::function<void()> post_frame;
+  std::function<int64_t()> probe;
+  int64_t last_probe_value = INT64_MIN;
+
+  std::thread worker;
+  std::mutex wake_mutex;
+  std::condition_variable wake;
+
+  std::atomic_bool running{false};
+  std::atomic_bool dirty{false};
+  std::atomic<int> max_fps{30};
+
+  // Counters for the stats view
+  std::atomic<uint64_t> requests{0};
+  std::atomic<uint64_t> frames{0};
+
+  // How often the probe is sampled while nothing else asks for a frame
+  static constexpr std::chrono::milliseconds PROBE_INTERVAL{100};
+
+public:
+  explicit FrameScheduler(std::function<void()> post, int fps = 30)
+      : post_frame(std::move(post)) {
+    set_max_fps(fps);
+  }
+
+  ~FrameScheduler() { stop(); }
+
+  FrameScheduler(const FrameScheduler &) = delete;
+  FrameScheduler &operator=(const FrameScheduler &) = delete;
+
+  void start() {
+    if (running.exchange(true)) {
+      return;
+    }
+    worker = std::thread([this] { run(); });
+  }
+
+  void stop() {
+    if (!running.exchange(false)) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(wake_mutex);
+    }
+    wake.notify_one();
+    if (worker.joinable()) {
+      worker.join();
+    }
+  }
+
+  // Mark the UI dirty. Safe to call from any thread, as often as needed.
+  void request_redraw() {
+    requests++;
+    if (!dirty.exchange(true)) {
+      {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+      }
+      wake.notify_one();
+    }
+  }
+
+  // Must be set before start()
+  void set_probe(std::function<int64_t()> fn) { probe = std::move(fn); }
+
+  void set_max_fps(int fps) { max_fps = std::clamp(fps, 1, 240); }
+  int get_max_fps() const { return max_fps; }
+
+  uint64_t get_request_count() const { return requests; }
+  uint64_t get_frame_count() const { return frames; }
+
+private:
+  void run() {
+    auto last_frame = std::chrono::steady_clock::now();
+
+    while (running) {
+      {
+        std::unique_lock<std::mutex> lock(wake_mutex);
+        wake.wait_for(lock, PROBE_INTERVAL,
+                      [this] { return dirty.load() || !running; });
+      }
+      if (!running) {
+        break;
+      }
+
+      // Hold back until the frame budget allows another frame; requests
+      // arriving meanwhile are merged into this one.
+      auto earliest = last_frame + std::chrono::microseconds(1000000 / max_fps);
+      if (dirty && std::chrono::steady_clock::now() < earliest) {
+        std::this_thread::sleep_until(earliest);
+      }
+
+      bool changed = dirty.exchange(false);
+      if (probe) {
+        int64_t value = probe();
+        if (value != last_probe_value) {
+          last_probe_value = value;
+          changed = true;
+        }
+      }
+
+      if (changed) {
+        last_frame = std::chrono::steady_clock::now();
+        frames++;
+        post_frame();
+      }
+    }
+  }
+};
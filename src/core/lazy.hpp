@@ -0,0 +1,38 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+// A shared object built on first use. Lets globals such as the player
+// exist without paying for their construction in modes that never touch
+// them. get() from several threads builds once; the others wait for it.
+template <typename T> class Lazy {
+private:
+  std::function<std::shared_ptr<T>()> factory;
+  std::shared_ptr<T> value;
+  std::once_flag once;
+  std::atomic_bool built{false};
+
+public:
+  explicit Lazy(std::function<std::shared_ptr<T>()> make) : factory(std::move(make)) {}
+
+  Lazy(const Lazy &) = delete;
+  Lazy &operator=(const Lazy &) = delete;
+
+  const std::shared_ptr<T> &get() {
+    std::call_once(once, [this] {
+      value = factory();
+      built = true;
+    });
+    return value;
+  }
+
+  // True once constructed; never constructs
+  bool ready() const { return built; }
+
+  T *operator->() { return get().get(); }
+  T &operator*() { return *get(); }
+  operator const std::shared_ptr<T> &() { return get(); }
+};
@@ -4,14 +4,17 @@
 #include "../storage/localStorage.cpp"
 #include "../audio/player.cpp"
 #include "../storage/playlist_handler.cpp"
+#include "../storage/download_manager.hpp"
 #include "../services/saavn/saavn.cpp"
 #include "../services/soundcloud/soundcloud.cpp"
+#include <csignal>
 #include <cstdio>
 #include <cstdlib>
 #include <curl/curl.h>
 #include <curl/urlapi.h>
 #include <exception>
 #include <fmt/core.h>
+#include <future>
 #include <fmt/format.h>
 #include <ftxui/component/component.hpp> // for Renderer, Input, Menu, etc.
 #include <ftxui/component/component_base.hpp>
@@ -36,10 +39,20 @@
 #include <vector>
 
 #include "../common/notification.hpp"
+#include "frame_scheduler.hpp"
+#include "lazy.hpp"
+#include "control_socket.hpp"
+#include "startup_profiler.hpp"
+#include "bandwidth_arbiter.hpp"
+#include "visualizer_bars.hpp"
 #include "../ai/json_output.hpp"
 #include "../ai/command_handler.hpp"
 #include "../ai/mcp_server.hpp"
 
+// Startup timings, reported with --profile-startup. Declared first so its
+// clock starts with static initialization.
+StartupProfiler startup_profile;
+
 // Data in string to render in UI
 std::vector<std::string> track_strings;
 std::vector<std::string> home_track_strings;
@@ -53,7 +66,6 @@ std::vector<Track> track_data_saavn;
 std::vector<Track> track_data_lastfm;
 std::vector<Track> track_data_soundcloud;
 std::vector<Track> track_data_forestfm;
-std::vector<Track> next_tracks;
 std::vector<Track> recently_played;
 std::vector<Track> trending_tracks;
 
@@ -62,8 +74,8 @@ std::string current_artist = "Welcome back, User!";
 
 static std::atomic<bool> daemon_mode_active{false};
 
-// Playlist track index
-int current_track_index = 0;
+// Set by "quit" over the control socket or SIGTERM in --server mode
+static std::atomic<bool> server_quit{false};
 
 int selected_trending = 0;
 
@@ -73,15 +85,25 @@ SoundCloud soundcloud;
 Saavn saavn;
 Justmusic justmusic;
 
-// Player instance
-auto player = std::make_shared<MusicPlayer>();
+// Player instance, built on first use: mpv and its event thread are
+// never started by modes that do not play anything
+Lazy<MusicPlayer> player([] {
+  auto phase = startup_profile.phase("player (mpv init)");
+  return std::make_shared<MusicPlayer>();
+});
 
 // Playlist source
 enum class PlaylistSource { None, Search, ForestFM, ClassicFM };
 PlaylistSource current_source = PlaylistSource::None;
 
-// Screen
-auto screen = ftxui::ScreenInteractive::Fullscreen();
+// Screen, built on first use (TUI only)
+Lazy<ftxui::ScreenInteractive> screen([] {
+  return std::shared_ptr<ftxui::ScreenInteractive>(
+      new ftxui::ScreenInteractive(ftxui::ScreenInteractive::Fullscreen()));
+});
+
+// All redraws go through the scheduler, which merges them into frames
+FrameScheduler frame_scheduler([] { screen->PostEvent(ftxui::Event::Custom); });
 
 // Menu selection
 int selected = 0;
@@ -202,90 +224,18 @@ void switch_playlist_source(const std::vector<Track> &new_tracks) {
   }
 
   // Update UI
-  screen.PostEvent(ftxui::Event::Custom);
+  frame_scheduler.request_redraw();
 }
 
-#ifdef WITH_CAVA
-// Visualizer data storage
-std::vector<double> visualizer_bars;
-std::vector<double> smoothed_bars(16, 0.0);  // For smooth animations
-std::mutex visualizer_mutex;
-
-// Fixed number of bars like CAVA
-static constexpr int NUM_BARS = 16;
+#ifdef WITH_VISUALIZER
+// Bars panel; one node reused by every frame, created once the config is read
+std::shared_ptr<VisualizerBars> visualizer_bars_node;
 
-// Visualizer component creator
 ftxui::Element create_visualizer_bars() {
-  using namespace ftxui;
-
-  std::lock_guard<std::mutex> lock(visualizer_mutex);
-
-  // Create fixed number of bars
-  std::vector<Element> bars;
-  const int MAX_HEIGHT = 8;  // Reduced height for better UI layout
-  const int BASE_HEIGHT = 1;  // Minimum bar height (base indicator)
-
-  // Always create exactly NUM_BARS bars
-  for (int bar_index = 0; bar_index < NUM_BARS; bar_index++) {
-    double target_height = BASE_HEIGHT;
-
-    // Get height from visualizer data if available
-    if (!visualizer_bars.empty() && bar_index * 2 < visualizer_bars.size()) {
-      // Average stereo channels
-      double value = (bar_index * 2 + 1 < visualizer_bars.size())
-                      ? (visualizer_bars[bar_index * 2] + visualizer_bars[bar_index * 2 + 1]) / 2.0
-                      : visualizer_bars[bar_index * 2];
-
-      // Reduced sensitivity like CAVA's down arrow (lower multiplier)
-      target_height = std::clamp(value * MAX_HEIGHT * 1.2, static_cast<double>(BASE_HEIGHT), static_cast<double>(MAX_HEIGHT));
-    }
-
-    // CAVA-style smoothing with gravity effect
-    // Fast rise, slow fall (like gravity)
-    if (target_height > smoothed_bars[bar_index]) {
-      // Rising: respond quickly (30% of the way)
-      smoothed_bars[bar_index] = smoothed_bars[bar_index] * 0.7 + target_height * 0.3;
-    } else {
-      // Falling: respond slowly (10% of the way) - gravity effect
-      smoothed_bars[bar_index] = smoothed_bars[bar_index] * 0.9 + target_height * 0.1;
-    }
-
-    int height = std::clamp(static_cast<int>(smoothed_bars[bar_index]), BASE_HEIGHT, MAX_HEIGHT);
-
-    // Create colored bar based on height
-    Color bar_color;
-    Color base_color = Color::GrayDark;  // Dim base color
-
-    if (height <= MAX_HEIGHT / 3) {
-      bar_color = Color::Green;
-    } else if (height <= (MAX_HEIGHT * 2) / 3) {
-      bar_color = Color::Yellow;
-    } else {
-      bar_color = Color::Red;
-    }
-
-    // Build vertical bar - always same structure, only height changes
-    // Use actual character width instead of size() modifier
-    std::vector<Element> bar_segments;
-    for (int h = 0; h < MAX_HEIGHT; h++) {
-      if (h < BASE_HEIGHT) {
-        // Base indicator (always visible) - wider with actual characters
-        bar_segments.push_back(text(" ▁▁") | color(base_color));
-      } else if (h < height) {
-        // Active part of the bar - wider with actual characters
-        bar_segments.push_back(text(" █") | color(bar_color));
-      } else {
-        // Empty space - same width
-        bar_segments.push_back(text("  "));
-      }
-    }
-
-    // Reverse so bars grow upward
-    std::reverse(bar_segments.begin(), bar_segments.end());
-    bars.push_back(vbox(std::move(bar_segments)));
+  if (!visualizer_bars_node) {
+    return ftxui::text("");
   }
-
-  return hbox(std::move(bars)) | center;
+  return visualizer_bars_node;
 }
 #endif
 
@@ -303,61 +253,28 @@ std::unique_ptr<TUIDiscordIntegration> tui_discord;
 bool is_discord_active = false;
 
 // In TUI mode initialization:
-void setupMPRISForDaemon(std::shared_ptr<MusicPlayer> player,
-                         std::vector<Track> next_tracks,
-                         int current_track_index) {
+void setupMPRISForDaemon(std::shared_ptr<MusicPlayer> player) {
   mpris_handler = std::make_unique<MPRISHandler>(player);
   mpris_handler->initialize();
   //system("notify-send 'MPRIS integration initialized'");
   notifications::send("MPRIS integration initialized");
 
 
+  // Metadata comes from the player's snapshot; the player owns the queue
+  // and has already moved it by the time these callbacks run.
   mpris_handler->setTrackCallbacks(
-      [&]() -> std::string {
-        return next_tracks.empty() ? "" : next_tracks[current_track_index].id;
+      [player]() -> std::string { return player->snapshot()->track.id; },
+      [player]() -> std::string { return player->snapshot()->track.name; },
+      [player]() -> std::string { return player->snapshot()->track.artist; },
+      [player]() {
+        auto snap = player->snapshot();
+        current_track = snap->track.name;
+        current_artist = snap->track.artist;
       },
-      [&]() -> std::string {
-        return next_tracks.empty() ? "" : next_tracks[current_track_index].name;
-      },
-      [&]() -> std::string {
-        return next_tracks.empty() ? ""
-                                  : next_tracks[current_track_index].artist;
-      },
-      [&]() {
-        // Update TUI state when next track is triggered via MPRIS
-        if (current_track_index < track_data.size() - 1) {
-          // current_track_index++;
-          // current_track_index = (current_track_index + 1) %
-          // track_data.size();
-
-          current_track_index = (current_track_index + 1) % next_tracks.size();
-          // screen.PostEvent(ftxui::Event::Custom);
-        }
-        // correct logic to next track:
-        //
-        //                                             current_track_name =
-        //                                             next_tracks[current_track_indexx-1].name;
-        //                                             current_track_artist =
-        //                                             next_tracks[current_track_indexx-1].artist;
-
-        current_track = next_tracks[current_track_index-1].name;
-        current_artist = next_tracks[current_track_index-1].artist;
-        // screen.PostEvent(ftxui::Event::Custom);
-        //       current_track_index = (current_track_index + 1) %
-        //       track_data.size();
-        // player->play(track_data[current_track_index].url);
-
-        // Trigger UI refresh if needed
-      },
-      [&]() {
-        // Update TUI state when previous track is triggered via MPRIS
-        if (current_track_index > 0) {
-          // current_track_index--;
-          // current_track_index = (current_track_index - 1) %
-          // track_data.size();
-          current_track_index = (current_track_index - 1) % next_tracks.size();
-          // screen.PostEvent(ftxui::Event::Custom);
-        }
+      [player]() {
+        auto snap = player->snapshot();
+        current_track = snap->track.name;
+        current_artist = snap->track.artist;
       }
       );
 
@@ -370,54 +287,148 @@ sdbus::IObject *g_concatenator{};
 #endif
 
 int main(int argc, char *argv[]) {
+  // --profile-startup may appear anywhere; the mode checks below look at
+  // fixed positions, so it is taken out of argv
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--profile-startup") {
+      startup_profile.enable();
+      std::copy(argv + i + 1, argv + argc + 1, argv + i);
+      argc--;
+      break;
+    }
+  }
+
+  // The command handler reaches the player only when a command needs it
+  auto get_player = []() -> std::shared_ptr<MusicPlayer> { return player.get(); };
+  const std::string socket_path = paths::get_socket_path();
+
+  // Playback daemon: owns the player and queue and serves --cmd,
+  // --mcp-server and the TUI's control socket clients until "quit"
+  if (argc >= 2 && std::string(argv[1]) == "--server") {
+    curl_global_init(CURL_GLOBAL_ALL);
+    auto config = std::make_shared<Config>();
+    notifications::init(config.get());
+    player->set_config(config);
+
+    ai::CommandHandler handler(get_player, soundcloud, saavn);
+    control::Server server(socket_path,
+                           [&handler](const std::string &command) { return handler.execute(command); });
+    server.set_quit_callback([] { server_quit = true; });
+    server.set_subscriber([&handler](const std::string &args, std::function<void(const std::string &)> emit) {
+      return handler.subscribe(args, std::move(emit));
+    });
+    if (!server.start()) {
+      std::cerr << "tuisic: cannot serve " << socket_path << " (already running?)" << std::endl;
+      return 1;
+    }
+    signal(SIGTERM, [](int) { server_quit = true; });
+    signal(SIGINT, [](int) { server_quit = true; });
+    startup_profile.mark("server ready");
+    startup_profile.report();
+    while (!server_quit) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+    server.stop();
+    player->stop();
+    return 0;
+  }
 
   // AI/CLI Command Mode: tuisic --cmd "play jazz"
   if (argc >= 3 && std::string(argv[1]) == "--cmd") {
-    auto cmd_handler = std::make_shared<ai::CommandHandler>(player, soundcloud, saavn);
     std::string command = argv[2];
-    std::string result = cmd_handler->execute(command);
+    std::string result;
+    {
+      auto phase = startup_profile.phase("command");
+      // A running daemon (or TUI) executes it; "play" starts one so the
+      // music outlives this process. Otherwise it runs in-process.
+      control::Client client;
+      bool starts_playback = command.rfind("play", 0) == 0;
+      if (client.connect(socket_path) ||
+          (starts_playback &&
+           control::spawn_daemon(control::executable_path(argv[0]), socket_path) &&
+           client.connect(socket_path))) {
+        result = client.request(command).value_or(
+            ai::JsonOutput::create_error("Playback daemon closed the connection"));
+      } else {
+        ai::CommandHandler handler(get_player, soundcloud, saavn);
+        result = handler.execute(command);
+      }
+    }
     std::cout << result << std::endl;
+    startup_profile.report();
     return 0;
   }
 
   // MCP Server Mode: tuisic --mcp-server
   if (argc >= 2 && std::string(argv[1]) == "--mcp-server") {
-    auto cmd_handler = std::make_shared<ai::CommandHandler>(player, soundcloud, saavn);
-    ai::MCPServer mcp_server(cmd_handler);
+    // Thin client of the playback daemon, started on demand; falls back to
+    // an in-process player if no daemon can run
+    bool remote = control::Client().connect(socket_path) ||
+                  control::spawn_daemon(control::executable_path(argv[0]), socket_path);
+    std::function<std::string(const std::string &)> execute;
+    std::function<std::function<void()>(const std::string &, std::function<void(const std::string &)>)>
+        subscribe;
+    std::shared_ptr<ai::CommandHandler> local;
+    if (remote) {
+      // Tool calls run on several MCP workers; each keeps its own
+      // connection so the daemon serves them side by side
+      execute = [&socket_path](const std::string &command) {
+        thread_local control::Client client;
+        auto response = client.connected() ? client.request(command) : std::nullopt;
+        if (!response && client.connect(socket_path)) {
+          response = client.request(command); // first use, or daemon restarted
+        }
+        return response.value_or(ai::JsonOutput::create_error("Playback daemon is not running"));
+      };
+      // Events come over a connection of their own
+      subscribe = [&socket_path](const std::string &args,
+                                 std::function<void(const std::string &)> emit) -> std::function<void()> {
+        auto stream = std::make_shared<control::EventStream>();
+        if (!stream->start(socket_path, args, std::move(emit))) {
+          return nullptr;
+        }
+        return [stream] { stream->stop(); };
+      };
+    } else {
+      local = std::make_shared<ai::CommandHandler>(get_player, soundcloud, saavn);
+      execute = [local](const std::string &command) { return local->execute(command); };
+      subscribe = [local](const std::string &args, std::function<void(const std::string &)> emit) {
+        return local->subscribe(args, std::move(emit));
+      };
+    }
+    ai::MCPServer mcp_server(execute, subscribe);
+    startup_profile.mark("mcp server ready");
+    startup_profile.report();
     mcp_server.run();
     return 0;
   }
 
 #ifdef WITH_MPRIS
-      tui_mpris = std::make_unique<TUIMPRISIntegration>(track_data, next_tracks, current_track_index);
+      tui_mpris = std::make_unique<TUIMPRISIntegration>();
       // tui_mpris->setup(player);
 #endif
 
-#ifdef WITH_DISCORD
-      tui_discord = std::make_unique<TUIDiscordIntegration>(track_data, next_tracks, current_track_index, player);
-      // Discord will be initialized when user starts playing
-#endif
-
-  if (argc >= 3 && std::string(argv[1]) == "--daemon") {
-    auto player = std::make_shared<MusicPlayer>();
-    std::string current_track_id = argv[2];
-    std::string current_track_name = argv[3];
-    std::string current_track_artist = argv[4];
-    std::string current_track_url = argv[5];
-    auto next_tracks = saavn.fetch_next_tracks(current_track_id.c_str());
-    std::vector<std::string> next_track_urls;
-    next_track_urls.push_back(current_track_url);
-    for (const auto &track : next_tracks) {
-      next_track_urls.push_back(track.url);
+  if (argc >= 2 && std::string(argv[1]) == "--daemon") {
+    // The TUI detaching with 'w' writes its playback session to our stdin
+    auto session = PlaybackSession::read_from(STDIN_FILENO);
+    if (!session) {
+      notifications::send("Daemon: no playback to continue");
+      return 1;
+    }
+    player->set_config(std::make_shared<Config>());
+    player->restore_session(*session);
+
+    // Controllable with --cmd while detached. The TUI that started us
+    // holds the socket until it has exited.
+    ai::CommandHandler handler(get_player, soundcloud, saavn);
+    control::Server server(socket_path,
+                           [&handler](const std::string &command) { return handler.execute(command); });
+    server.set_subscriber([&handler](const std::string &args, std::function<void(const std::string &)> emit) {
+      return handler.subscribe(args, std::move(emit));
+    });
+    for (int attempt = 0; attempt < 50 && !server.start(); attempt++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
     }
-    player->create_playlist(next_track_urls);
-    // Create Track object for lyrics support
-    Track current_track_obj{current_track_name, current_track_artist, current_track_url, current_track_id, "saavn"};
-    player->play(current_track_obj);
-    int current_track_indexx = player->get_current_playlist_index();
-    // system(("notify-send 'Tuisic' 'Playing'" +
-    //         std::to_string(current_track_indexx))
-    //            .c_str());
 
     double current_position = 0.0;
     double total_duration = 0.0;
@@ -433,7 +444,6 @@ int main(int argc, char *argv[]) {
       // Prevent division by zero and ensure valid percentage
       if (total_duration > 0) {
         progress_percentage = static_cast<int>((pos / dur) * 100.0);
-        screen.PostEvent(ftxui::Event::Custom);
       }
     });
 
@@ -442,7 +452,7 @@ int main(int argc, char *argv[]) {
     auto connection = sdbus::createSessionBusConnection(serviceName);
     // connection->requestName(serviceName);
     sdbus::ObjectPath objectPath{"/org/mpris/MediaPlayer2"};
-    //setupMPRISForDaemon(player, next_tracks, current_track_indexx);
+    //setupMPRISForDaemon(player);
 
 
      auto object = sdbus::createObject(*connection, std::move(objectPath));
@@ -462,11 +472,12 @@ int main(int argc, char *argv[]) {
 
      auto getMetadata = [&]() -> std::map<std::string, sdbus::Variant> {
        std::map<std::string, sdbus::Variant> metadata;
-       metadata["mpris:trackid"] = sdbus::Variant(current_track_id);
-       metadata["xesam:title"] = sdbus::Variant(current_track_name);
+       auto snap = player->snapshot();
+       metadata["mpris:trackid"] = sdbus::Variant(snap->track.id);
+       metadata["xesam:title"] = sdbus::Variant(snap->track.name);
        metadata["position"] = sdbus::Variant(int64_t(current_position * 1000000));
        metadata["xesam:artist"] =
-           sdbus::Variant(std::vector<std::string>{current_track_artist});
+           sdbus::Variant(std::vector<std::string>{snap->track.artist});
        metadata["mpris:length"] =
            sdbus::Variant(int64_t(total_duration * 1000000)); // 3 minutes in microseconds
        return metadata;
@@ -525,9 +536,6 @@ int main(int argc, char *argv[]) {
                                              {},
                                              [&](sdbus::MethodCall call) {
                                                player->next_track();
-                                                 current_track_indexx = (current_track_indexx + 1) % next_tracks.size();
-                                                 current_track_name = next_tracks[current_track_indexx-1].name;
-                                                 current_track_artist = next_tracks[current_track_indexx-1].artist;
                                                updateMetadata();
                                                updatePlaybackStatus();
                                                auto reply = call.createReply();
@@ -606,11 +614,8 @@ int main(int argc, char *argv[]) {
                                      {}})
          .forInterface(interfaceName2);
 
-    player->set_end_of_track_callback([&] {
-      current_track_indexx = (current_track_indexx + 1) % next_tracks.size();
-      current_track_name = next_tracks[current_track_indexx-1].name;
-      current_track_artist = next_tracks[current_track_indexx-1].artist;
-    });
+    // The player advances its queue on end of file; only republish metadata
+    player->set_end_of_track_callback([&] { updateMetadata(); });
 
     // Run the I/O event loop on the bus connection.
     std::thread([&connection] { connection->enterEventLoop(); }).detach();
@@ -618,37 +623,107 @@ int main(int argc, char *argv[]) {
     updatePlaybackStatus();
 
     #endif
+    startup_profile.mark("daemon ready");
+    startup_profile.report();
     // keep alive
     std::this_thread::sleep_for(std::chrono::hours(24 * 365));
     return 0;
   }
   curl_global_init(CURL_GLOBAL_ALL);
-  auto config = std::make_shared<Config>();
+
+  // Independent startup work runs side by side: mpv comes up, saved
+  // tracks load and trending is fetched while the config is parsed and
+  // the UI is built
+  auto player_ready = std::async(std::launch::async, [] { player.get(); });
+  auto saved_tracks_ready = std::async(std::launch::async, [] {
+    auto phase = startup_profile.phase("load saved tracks");
+    loadData(recently_played, favorite_tracks);
+  });
+  std::thread trending_thread([] {
+    auto phase = startup_profile.phase("fetch trending");
+    trending_tracks = saavn.fetch_trending();
+    for (const auto &track : trending_tracks) {
+      trending_track_strings.push_back(track.to_string());
+    }
+    frame_scheduler.request_redraw();
+  });
+  trending_thread.detach();
+
+  std::shared_ptr<Config> config;
+  {
+    auto phase = startup_profile.phase("config");
+    config = std::make_shared<Config>();
+  }
 
   // Initialize notification system with config
   notifications::init(config.get());
+  {
+    auto phase = startup_profile.phase("player config (cache, library)");
+    player->set_config(config);
+  }
 
-#ifdef WITH_CAVA
-  // Set up audio callback for visualizer
-  player->set_audio_callback([&](const std::vector<double>& audio_data) {
-    static int ui_callback_count = 0;
-    ui_callback_count++;
+#ifdef WITH_DISCORD
+      tui_discord = std::make_unique<TUIDiscordIntegration>(player);
+      // Discord will be initialized when user starts playing
+#endif
 
-    if (ui_callback_count == 1) {
-      std::cout << "[Main] UI callback working! Received " << audio_data.size() << " bars" << std::endl;
-    }
+  // Downloads left unfinished by the last session resume here
+  auto download_phase = std::make_unique<StartupProfiler::Scope>(&startup_profile, "download queue");
+  DownloadManager downloads(paths::get_data_dir() + "/downloads.json",
+                            config->get_download_workers(),
+                            config->get_download_connections(),
+                            config->get_download_transcode());
+  download_phase.reset();
+  downloads.set_change_callback([] { frame_scheduler.request_redraw(); });
+  // Finished downloads play from disk from now on
+  downloads.set_complete_callback([library = player->get_library()](const DownloadJob &job) {
+    library->add(job.track, job.output);
+  });
 
-    std::lock_guard<std::mutex> lock(visualizer_mutex);
-    visualizer_bars = audio_data;
+  // Kept tracks: finish from the recording, fetching only what is missing
+  player->set_keep_callback([&downloads](const KeptTrack &kept) {
+    downloads.enqueue(kept.track, kept.output, kept.format, kept.file, !kept.complete,
+                      kept.stream);
+  });
 
-    if (ui_callback_count % 100 == 0) {
-      std::cout << "[Main] UI updated " << ui_callback_count << " times, bars: " << visualizer_bars.size() << std::endl;
-    }
+  // While the TUI runs, --cmd and --mcp-server drive its player, unless a
+  // daemon already serves the socket
+  ai::CommandHandler socket_commands(get_player, soundcloud, saavn);
+  control::Server control_server(
+      socket_path, [&socket_commands](const std::string &command) {
+        return socket_commands.execute(command);
+      });
+  control_server.set_subscriber([&socket_commands](const std::string &args, std::function<void(const std::string &)> emit) {
+    return socket_commands.subscribe(args, std::move(emit));
+  });
+  control_server.start();
+
+  // Background transfers back off while the playing stream runs low
+  BandwidthArbiter bandwidth(
+      [] {
+        auto snap = player->snapshot();
+        return BandwidthArbiter::Buffer{
+            snap->playing() && snap->streaming ? snap->cache_duration : -1.0,
+            snap->stream_stats.readahead_secs};
+      },
+      config->get_throttle_below_secs(), config->get_download_throttle_kbps());
+  downloads.set_arbiter(&bandwidth);
+  bandwidth.start();
+  downloads.start();
 
-    screen.PostEvent(ftxui::Event::Custom);
+#ifdef WITH_VISUALIZER
+  // Set up audio callback for visualizer
+  player->set_audio_callback([&](const std::vector<double> &) {
+    frame_scheduler.request_redraw();
   });
 
-  std::cout << "[Main] Audio callback set up successfully" << std::endl;
+  visualizer_bars_node = std::make_shared<VisualizerBars>(
+      [] {
+        player->mark_visualizer_drawn();
+        return player->get_visualization_data();
+      },
+      [](int bars) { player->set_visualizer_bars(bars); },
+      VisualizerBars::parse_style(config->get_visualizer_style()), config->get_visualizer_bars());
 #endif
 
   using namespace ftxui;
@@ -657,8 +732,6 @@ int main(int argc, char *argv[]) {
   std::string search_query;
   std::string current_album = "";
   std::string button_text = "Play";
-  std::mutex playlist_mutex;
-  std::vector<std::string> next_playlist;
 
   // Placeholder track list
   std::vector<std::string> tracks = {};
@@ -670,7 +743,6 @@ int main(int argc, char *argv[]) {
     current_album = "";
     button_text = "Play";
     selected = 0;
-    current_track_index = 0;
   };
 
   // for progress
@@ -702,15 +774,6 @@ int main(int argc, char *argv[]) {
   // });
   // trending_thread.detach();
 
-  std::thread trending_thread([&]() {
-    trending_tracks = saavn.fetch_trending();
-    for (const auto &track : trending_tracks) {
-      trending_track_strings.push_back(track.to_string());
-    }
-    screen.PostEvent(Event::Custom);
-  });
-  trending_thread.detach();
-
   // Components
   Component input_search = Input(&search_query, "Search for music...");
   input_search = Input(&search_query, "Search for music...") |
@@ -728,7 +791,7 @@ int main(int argc, char *argv[]) {
   auto menu = Menu(&tracks, &selected);
   menu =
       Menu(&tracks, &selected) |
-      CatchEvent([&button_text, &next_playlist, &playlist_mutex, &config,
+      CatchEvent([&button_text, &config, &downloads,
                   argv](Event event) {
         if (event == Event::Return) {
           // std::cerr << "Selected: " << selected << std::endl;
@@ -743,25 +806,27 @@ int main(int argc, char *argv[]) {
             current_track = track_data[selected].name;
             current_artist = track_data[selected].artist;
             button_text = "Pause";
-            screen.PostEvent(Event::Custom);
+            frame_scheduler.request_redraw();
 
             if (track_data[selected].id != "") {
 
-              std::thread next_tracks_thread([&]() {
+              Track chosen = track_data[selected];
+              std::thread next_tracks_thread([&, chosen]() {
                 try {
                   /* std::cerr << "Fetttchiing nextttttttttttttt"; */
                   // system(("notify-send 'Tuisic' " + track_data[selected].id +
                   //         track_data[selected].url)
                   //            .c_str());
-                if(track_data[selected].source=="lastfm"){
-                    player->play(track_data[selected]);
+                if(chosen.source=="lastfm"){
+                    player->create_playlist({chosen});
                     return;
                 }
-                if(track_data[selected].source=="soundcloud"){
-                    next_tracks = soundcloud.fetch_next_tracks(track_data[selected].url);
-                }else {//if(track_data[selected].source=="saavn"){
-                    // system(("notify-send 'Tuisic' 'Fetching next'" + track_data[selected].id).c_str());
-                    next_tracks = saavn.fetch_next_tracks(track_data[selected].id, track_data[selected].language);
+                std::vector<Track> next_tracks;
+                if(chosen.source=="soundcloud"){
+                    next_tracks = soundcloud.fetch_next_tracks(chosen.url);
+                }else {//if(chosen.source=="saavn"){
+                    // system(("notify-send 'Tuisic' 'Fetching next'" + chosen.id).c_str());
+                    next_tracks = saavn.fetch_next_tracks(chosen.id, chosen.language);
                     // system(("notify-send 'Tuisic' 'Fetching next'" + next_tracks[0].id).c_str());
 
                 }
@@ -776,20 +841,9 @@ int main(int argc, char *argv[]) {
                   //   player->play(track_data[selected].url);
                   //   return;
                   // }
-                  std::vector<std::string> next_track_urls;
-                  next_track_urls.push_back(track_data[selected].url);
-                  for (const auto &track : next_tracks) {
-                    next_track_urls.push_back(track.url);
-                  }
-                  next_tracks.insert(next_tracks.begin(), track_data[selected]);
-
-                  {
-                    std::lock_guard<std::mutex> lock(playlist_mutex);
-                    next_playlist = next_track_urls;
-                  }
-                  player->create_playlist(next_track_urls);
-                  current_track_index = 0;
-                  player->play(next_tracks[0]);
+                  // Selected track first, then its recommendations
+                  next_tracks.insert(next_tracks.begin(), chosen);
+                  player->create_playlist(next_tracks);
 
 
                 #ifdef WITH_MPRIS
@@ -811,7 +865,7 @@ int main(int argc, char *argv[]) {
                   }
                 #endif
 
-                  screen.PostEvent(Event::Custom);
+                  frame_scheduler.request_redraw();
                 } catch (const std::exception &e) {
                   // std::cerr << e.what() << std::endl;
                     notifications::send("Error: " + std::string(e.what()));
@@ -820,7 +874,7 @@ int main(int argc, char *argv[]) {
               next_tracks_thread.detach();
             } else {
               // Track has no ID - play directly without fetching next tracks
-              player->play(track_data[selected].url);
+              player->create_playlist({track_data[selected]});
 #ifdef WITH_MPRIS
               if(!is_mpris_active){
                   tui_mpris->setup(player);
@@ -841,9 +895,6 @@ int main(int argc, char *argv[]) {
 #endif
             }
 
-            /* player->create_playlist(next_tracks_strings); */
-            /* current_track_index = 0; */
-            /* player->play(next_tracks[0].url); */
           }
           return true;
         }
@@ -869,7 +920,7 @@ int main(int argc, char *argv[]) {
         }
         if (event == Event::Character('L')) {
           player->toggle_subtitles();
-          screen.PostEvent(Event::Custom); // Refresh UI to show/hide subtitle section
+          frame_scheduler.request_redraw(); // Refresh UI to show/hide subtitle section
           return true;
         }
 
@@ -883,7 +934,8 @@ int main(int argc, char *argv[]) {
 
         if (event == Event::Character('d')) {
           if (selected >= 0 && selected < track_data.size()) {
-            std::string current_song = track_data[selected].name + ".mp3";
+            std::string format = config->get_download_format();
+            std::string current_song = track_data[selected].name + "." + format;
             /* std::string current_song = player->get_current_track(); */
             std::replace(current_song.begin(), current_song.end(), '/', '_');
             std::replace(current_song.begin(), current_song.end(), '\\', '_');
@@ -891,20 +943,14 @@ int main(int argc, char *argv[]) {
              * ".mp3"; */
             std::string path = config->get_download_path();
 
-            // Start download
-            if (player->download_track(track_data[selected].url, path,
-                                       current_song)) {
-              // system(("notify-send \"Started downloading: " +
-              //         track_data[selected].name + "\"")
-              //            .c_str());
-                notifications::send_download_started("" + track_data[selected].name);
-            } else {
-              // system(("notify-send \"Failed to start download: " +
-              //         track_data[selected].name + "\"")
-              //            .c_str());
-                notifications::send_download_failed("" + track_data[selected].name);
-              
+            // The playing track is kept from its stream instead of being
+            // fetched twice; anything else is queued. Progress shows in the
+            // status bar.
+            std::string output = path + "/" + current_song;
+            if (!player->keep_current(track_data[selected], output, format)) {
+              downloads.enqueue(track_data[selected], output, format);
             }
+            notifications::send_download_started("" + track_data[selected].name);
           }
           return true;
         }
@@ -926,19 +972,36 @@ int main(int argc, char *argv[]) {
           notifications::send("Starting daemon...");
 
 
-          std::string url = player->get_current_track();
+          // The daemon continues from the current session, read from a
+          // pipe on its stdin
+          int session_pipe[2];
+          if (pipe2(session_pipe, O_CLOEXEC) != 0) {
+            notifications::send("Failed to start daemon");
+            return true;
+          }
+          std::string program = control::executable_path(argv[0]);
           pid_t pid = fork();
           if (pid < 0) {
-            exit(1);
+            close(session_pipe[0]);
+            close(session_pipe[1]);
+            notifications::send("Failed to start daemon");
+            return true;
           }
           if (pid == 0) {
             // child: replace image with daemon invocation
-            execl(argv[0], argv[0], "--daemon", track_data[0].id.c_str(),
-                  track_data[0].name.c_str(), track_data[0].artist.c_str(),
-                  url.c_str(), nullptr);
+            dup2(session_pipe[0], STDIN_FILENO);
+            execl(program.c_str(), program.c_str(), "--daemon", nullptr);
             _exit(1);
           }
-          screen.Exit();
+          close(session_pipe[0]);
+          auto session = player->export_session();
+          player->stop();
+          // A daemon that failed to start must not kill us with SIGPIPE
+          signal(SIGPIPE, SIG_IGN);
+          if (!session.write_to(session_pipe[1])) {
+            notifications::send("Daemon did not take over playback");
+          }
+          screen->Exit();
         #endif
         }
 
@@ -955,7 +1018,7 @@ int main(int argc, char *argv[]) {
             if (!track_data_forestfm.empty()) {
               player->stop();
             }
-            player->play(trending_tracks[selected_trending].url);
+            player->create_playlist(trending_tracks, selected_trending);
             current_track = trending_tracks[selected_trending].name;
             current_artist = trending_tracks[selected_trending].artist;
             button_text = "Pause";
@@ -978,7 +1041,7 @@ int main(int argc, char *argv[]) {
                 tui_discord->notifyTrackChange();
             }
 #endif
-            screen.PostEvent(Event::Custom);
+            frame_scheduler.request_redraw();
           }
           return true;
         }
@@ -1002,7 +1065,7 @@ int main(int argc, char *argv[]) {
             player->pause();
             button_text = "Play";
           } else {
-            player->play(track_data_forestfm[current_track_index].url);
+            player->play_playlist();
             button_text = "Pause";
           }
         } else if (current_source == PlaylistSource::Search) {
@@ -1012,7 +1075,7 @@ int main(int argc, char *argv[]) {
             if (!track_data_forestfm.empty()) {
               player->stop();
             }
-            player->play(track_data[selected].url);
+            player->create_playlist(track_data, selected);
             current_artist = track_data[selected].artist;
             current_track = track_data[selected].name;
             button_text = "Pause";
@@ -1020,13 +1083,13 @@ int main(int argc, char *argv[]) {
         } else {
           if (selected >= 0 && selected < track_data.size()) {
             current_source = PlaylistSource::Search;
-            player->play(track_data[selected].url);
+            player->create_playlist(track_data, selected);
             current_track = track_data[selected].name;
             current_artist = track_data[selected].artist;
             button_text = "Pause";
           }
         }
-        screen.PostEvent(Event::Custom);
+        frame_scheduler.request_redraw();
       },
       ButtonOption::Animated(Color::Default, Color::GrayDark, Color::Default,
                              Color::White));
@@ -1056,7 +1119,7 @@ int main(int argc, char *argv[]) {
 
         // Reset track information
         current_track = "Fetching tracks...";
-        screen.PostEvent(Event::Custom);
+        frame_scheduler.request_redraw();
 
         // Consider using a separate thread for fetching
         std::thread fetch_thread([&]() {
@@ -1071,11 +1134,6 @@ int main(int argc, char *argv[]) {
 
             is_fetching = false;
             if (!track_data_forestfm.empty()) {
-              // Create playlist of URLs
-              std::vector<std::string> track_urls;
-              for (const auto &track : track_data_forestfm) {
-                track_urls.push_back(track.url);
-              }
               current_album = track_data_forestfm[0].name;
 
               // Stop current playback if needed
@@ -1084,21 +1142,19 @@ int main(int argc, char *argv[]) {
               }
 
               // Create playlist and start playing
-              player->create_playlist(track_urls);
-              current_track_index = 0;
+              player->create_playlist(track_data_forestfm);
               button_text_forestfm = "❚❚";
               current_source = PlaylistSource::ForestFM;
 
               // Update current track info
               current_track = track_data_forestfm[0].name;
               current_artist = track_data_forestfm[0].artist;
-              player->play(track_data_forestfm[0]);
               button_text = "Pause";
             }
-            screen.PostEvent(Event::Custom);
+            frame_scheduler.request_redraw();
           } catch (const std::exception &e) {
             current_track = "Error fetching tracks: " + std::string(e.what());
-            screen.PostEvent(Event::Custom);
+            frame_scheduler.request_redraw();
           }
         });
         fetch_thread.detach(); // Allow thread to run independently
@@ -1143,7 +1199,7 @@ int main(int argc, char *argv[]) {
             // current_source = PlaylistSource::Custom;
             current_track = "Custom Playlist";
           }
-          screen.PostEvent(Event::Custom);
+          frame_scheduler.request_redraw();
           return true;
         }
         return false;
@@ -1163,29 +1219,23 @@ int main(int argc, char *argv[]) {
       tui_discord->notifyPlaybackChange();
     }
 #endif
-    screen.PostEvent(Event::Custom);
+    frame_scheduler.request_redraw();
   });
   double current_position = 0.0;
   double total_duration = 0.0;
   int progress_percentage = 0;
 
-  // Update the time callback to correctly calculate progress
+  // The player only reports position about once a second; the renderer
+  // reads the interpolated position, and the scheduler probe below posts a
+  // frame whenever the displayed second changes.
   player->set_time_callback([&](double pos, double dur) {
-    current_position = pos;
-    total_duration = dur;
-
-    // Prevent division by zero and ensure valid percentage
-    if (total_duration > 0) {
-      progress_percentage = static_cast<int>((pos / dur) * 100.0);
-      screen.PostEvent(Event::Custom);
-    }
+    frame_scheduler.request_redraw();
   });
 
+  // The renderer reads the subtitle from the player snapshot
   std::string current_subtitle_text = "No subtitle";
   player->set_subtitle_callback([&](const std::string &subtitle) {
-    // Update your UI with the subtitle
-    current_subtitle_text = subtitle;
-    screen.PostEvent(Event::Custom); // Trigger screen update
+    frame_scheduler.request_redraw(); // Trigger screen update
   });
 
   Component progress_slider = Slider("", &progress_percentage, 0, 100, 1);
@@ -1201,26 +1251,9 @@ int main(int argc, char *argv[]) {
     return false;
   });
 
-  auto button_prev = Button("<-", [&] {
-    if (current_source == PlaylistSource::ForestFM &&
-        !track_data_forestfm.empty()) {
-      current_track_index =
-          (current_track_index - 1 + track_data_forestfm.size()) %
-          track_data_forestfm.size();
-      player->play(track_data_forestfm[current_track_index].url);
-
-      current_track = track_data_forestfm[current_track_index].name;
-      current_artist = track_data_forestfm[current_track_index].artist;
-      button_text = "Pause";
-    } else if (current_source == PlaylistSource::Search &&
-               !track_data.empty()) {
-      player->previous_track(track_data, selected);
-
-      current_track = track_data[selected].name;
-      current_artist = track_data[selected].artist;
-      button_text = "Pause";
-    }
-
+  // Skips go through the player's queue; the labels follow the queue's
+  // current entry through the observer below.
+  auto notify_integrations = [&] {
 #ifdef WITH_MPRIS
     if (is_mpris_active && tui_mpris) {
       tui_mpris->notifyTrackChange();
@@ -1233,83 +1266,44 @@ int main(int argc, char *argv[]) {
       tui_discord->notifyTrackChange();
     }
 #endif
+  };
 
-    screen.PostEvent(Event::Custom);
+  auto button_prev = Button("<-", [&] {
+    if (!player->queue().empty()) {
+      player->previous_track();
+      button_text = "Pause";
+    }
+    notify_integrations();
+    frame_scheduler.request_redraw();
   });
 
   auto button_next = Button("->", [&] {
-    if (current_source == PlaylistSource::ForestFM &&
-        !track_data_forestfm.empty()) {
-      current_track_index =
-          (current_track_index + 1) % track_data_forestfm.size();
-      player->play(track_data_forestfm[current_track_index]);
-
-      current_track = track_data_forestfm[current_track_index].name;
-      current_artist = track_data_forestfm[current_track_index].artist;
-      button_text = "Pause";
-    } else if (current_source == PlaylistSource::Search &&
-               !track_data.empty()) {
-      player->next_track(track_data, selected);
-
-      current_track = track_data[selected].name;
-      current_artist = track_data[selected].artist;
+    if (!player->queue().empty()) {
+      player->next_track();
       button_text = "Pause";
     }
+    notify_integrations();
+    frame_scheduler.request_redraw();
+  });
 
-#ifdef WITH_MPRIS
-    if (is_mpris_active && tui_mpris) {
-      tui_mpris->notifyTrackChange();
-      tui_mpris->notifyPlaybackChange();
+  // Keep the now-playing labels on the queue's current entry. Changes can
+  // come from the mpv event thread, so apply them on the UI thread.
+  player->queue().subscribe([&](const QueueChange &change) {
+    if (change.kind != QueueChange::Kind::CurrentChanged || !change.track) {
+      return;
     }
-#endif
-
-#ifdef WITH_DISCORD
-    if (is_discord_active && tui_discord) {
-      tui_discord->notifyTrackChange();
-    }
-#endif
-
-    screen.PostEvent(Event::Custom);
+    TrackHandle track = change.track;
+    screen->Post([track] {
+      current_track = track->name;
+      current_artist = track->artist;
+    });
+    frame_scheduler.request_redraw();
   });
 
   player->set_end_of_track_callback([&] {
-    // Automatically update track info when a track ends
-    if (!next_tracks.empty()) {
-      /* current_track_index = player->get_current_playlist_index(); */
-      // std::cerr << next_tracks.size() << std::endl;
-      current_track_index = (current_track_index + 1) % next_tracks.size();
-      current_track = next_tracks[current_track_index].name;
-      current_artist = next_tracks[current_track_index].artist;
-      player->next_track(next_tracks, current_track_index);
-    } else if (!track_data_forestfm.empty()) {
-      current_track_index =
-          (current_track_index + 1) % track_data_forestfm.size();
-      current_track = track_data_forestfm[current_track_index].name;
-      current_artist = track_data_forestfm[current_track_index].artist;
-    } else if (!track_data.empty()) {
-      selected = (selected + 1) % track_data.size();
-      current_track = track_data[selected].name;
-      current_artist = track_data[selected].artist;
-    }
-
-#ifdef WITH_MPRIS
-    if (is_mpris_active && tui_mpris) {
-      tui_mpris->notifyTrackChange();
-      tui_mpris->notifyPlaybackChange();
-    }
-#endif
-
-#ifdef WITH_DISCORD
-    if (is_discord_active && tui_discord) {
-      tui_discord->notifyTrackChange();
-    }
-#endif
-
-    // Ensure UI updates
-    screen.PostEvent(Event::Custom);
-
-    // Continue playback
-    /* player->next_track(track_data, selected); */
+    // The player has already advanced its queue
+    notify_integrations();
+    frame_scheduler.request_redraw();
   });
 
   // Component tree
@@ -1344,6 +1338,9 @@ int main(int argc, char *argv[]) {
       }),
   });
 
+  // Stream stats (stalls, link speed, buffer) in the status bar
+  bool show_stream_stats = false;
+
   component =
       component | CatchEvent([&](Event event) {
         // Check if search input is focused
@@ -1388,15 +1385,12 @@ int main(int argc, char *argv[]) {
                 button_text = "Play";
                 button_text_forestfm = "▶";
               } else {
-                player->play(track_data_forestfm[current_track_index].url);
-                current_track = track_data_forestfm[current_track_index].name;
-                current_artist =
-                    track_data_forestfm[current_track_index].artist;
+                player->play_playlist();
                 button_text = "Pause";
                 button_text_forestfm = "❚❚";
               }
             }
-            screen.PostEvent(Event::Custom);
+            frame_scheduler.request_redraw();
             return true;
           }
 
@@ -1411,61 +1405,30 @@ int main(int argc, char *argv[]) {
           }
 
           if (event == Event::Character('>')) { // Next track
-            if (!next_tracks.empty()) {
-              /* current_track_index = player->get_current_playlist_index(); */
-              // std::cerr << next_tracks.size() << std::endl;
-              current_track_index =
-                  (current_track_index + 1) % next_tracks.size();
-              current_track = next_tracks[current_track_index].name;
-              current_artist = next_tracks[current_track_index].artist;
-              player->next_track(next_tracks, current_track_index);
-            } else if (!track_data_forestfm.empty()) {
-              current_track_index =
-                  (current_track_index + 1) % track_data_forestfm.size();
-              current_track = track_data_forestfm[current_track_index].name;
-              current_artist = track_data_forestfm[current_track_index].artist;
-            } else if (!track_data.empty()) {
-              selected = (selected + 1) % track_data.size();
-              current_track = track_data[selected].name;
-              current_artist = track_data[selected].artist;
-            }
-
-            // Ensure UI updates
-            screen.PostEvent(Event::Custom);
+            player->next_track();
+            frame_scheduler.request_redraw();
           }
           if (event == Event::Character('<')) { // Previous track
-            if (!next_tracks.empty()) {
-              /* current_track_index = player->get_current_playlist_index(); */
-              // std::cerr << next_tracks.size() << std::endl;
-              current_track_index =
-                  (current_track_index - 1) % next_tracks.size();
-              current_track = next_tracks[current_track_index].name;
-              current_artist = next_tracks[current_track_index].artist;
-              player->next_track(next_tracks, current_track_index);
-            } else if (!track_data_forestfm.empty()) {
-              current_track_index =
-                  (current_track_index - 1) % track_data_forestfm.size();
-              current_track = track_data_forestfm[current_track_index].name;
-              current_artist = track_data_forestfm[current_track_index].artist;
-            } else if (!track_data.empty()) {
-              selected = (selected - 1) % track_data.size();
-              current_track = track_data[selected].name;
-              current_artist = track_data[selected].artist;
-            }
-            screen.PostEvent(Event::Custom);
+            player->previous_track();
+            frame_scheduler.request_redraw();
           }
 
           if (event == Event::Character('+') ||
               event == Event::Character('=')) {
             volume = std::min(100, volume + 5);
             player->set_volume(volume);
-            screen.PostEvent(Event::Custom);
+            frame_scheduler.request_redraw();
             return true;
           }
           if (event == Event::Character('-')) {
             volume = std::max(0, volume - 5);
             player->set_volume(volume);
-            screen.PostEvent(Event::Custom);
+            frame_scheduler.request_redraw();
+            return true;
+          }
+          if (event == Event::Character('i')) {
+            show_stream_stats = !show_stream_stats;
+            frame_scheduler.request_redraw();
             return true;
           }
           if (event == Event::Character('m')) { // Mute toggle
@@ -1477,7 +1440,7 @@ int main(int argc, char *argv[]) {
               volume = previous_volume;
             }
             player->set_volume(volume);
-            screen.PostEvent(Event::Custom);
+            frame_scheduler.request_redraw();
             return true;
           }
 
@@ -1487,25 +1450,39 @@ int main(int argc, char *argv[]) {
         // Global quit shortcut
         if (event == Event::Character('q')) {
           saveData(recently_played, favorite_tracks);
-          screen.Exit();
+          screen->Exit();
           return true;
         }
 
         // Escape to unfocus search box
         if (event == Event::Escape) {
-          screen.PostEvent(Event::Custom);
+          frame_scheduler.request_redraw();
           return true;
         }
 
         return false;
       });
 
-  // Data Persistence
-  loadData(recently_played, favorite_tracks);
+  // Data Persistence, loaded in the background since startup
+  saved_tracks_ready.get();
   std::vector<Element> smoe;
 
   // Layout
   auto renderer = Renderer(component, [&] {
+    static bool first_frame = true;
+    if (first_frame) {
+      first_frame = false;
+      startup_profile.mark("first frame");
+    }
+    // One snapshot per frame keeps everything drawn consistent
+    auto snap = player->snapshot();
+    current_position = snap->interpolated_position();
+    total_duration = snap->duration;
+    current_subtitle_text = snap->subtitle;
+    if (total_duration > 0) {
+      progress_percentage = static_cast<int>((current_position / total_duration) * 100.0);
+    }
+
     return vbox({
         hbox({text(" λ ") | bgcolor(Color::Blue) | color(Color::White),
               text(" 🎵" + current_track + " 🎵") | bold | center,
@@ -1538,9 +1515,9 @@ int main(int argc, char *argv[]) {
                 }) | center,
                 separator(),
                 hbox({
-                #ifdef WITH_CAVA
+                #ifdef WITH_VISUALIZER
                     // separator(),
-                    create_visualizer_bars() | flex,
+                    create_visualizer_bars(),
                 #else
                     [&]() -> Element {
                       // Fetch the ASCII art for testing
@@ -1634,7 +1611,46 @@ int main(int argc, char *argv[]) {
                   text("./,:Skip ") | dim,
                   text(">/<:Next/Prev ") | dim,
                   text("m:Mute ") | dim,
+                  text("i:Stats ") | dim,
               }) | center,
+              [&]() -> Element {
+                auto snap = player->snapshot();
+                if (!show_stream_stats || !snap->streaming) {
+                  return text("");
+                }
+                const auto &st = snap->stream_stats;
+                return text(fmt::format(" ⇣ {:.0f}s/{:.0f}s · {:.0f} KB/s · ≤{} kbps · {} stalls ",
+                                        std::max(snap->cache_duration, 0.0),
+                                        st.readahead_secs, st.throughput / 1024.0,
+                                        snap->quality_kbps, st.stalls)) |
+                       color(st.stalls > 0 ? Color::Yellow : Color::GrayLight);
+              }(),
+#ifdef WITH_VISUALIZER
+              [&]() -> Element {
+                if (!show_stream_stats) {
+                  return text("");
+                }
+                const auto &vs = player->snapshot()->viz_stats;
+                int64_t now = PlaybackSnapshot::clock_now();
+                double active = vs.active_total(now);
+                double suspended = vs.suspended_total(now);
+                double total = active + suspended;
+                return text(fmt::format(" ▮ viz {} · {} frames · idle {:.0f}% ",
+                                        vs.suspended ? "off" : "on", vs.frames,
+                                        total > 0 ? 100.0 * suspended / total : 0.0)) |
+                       color(Color::GrayLight);
+              }(),
+#endif
+              [&]() -> Element {
+                auto dl = downloads.summary();
+                if (dl.running + dl.queued == 0) {
+                  return text("");
+                }
+                return text(fmt::format(" ⬇ {}% ({} active, {} queued) ",
+                                        static_cast<int>(dl.progress), dl.running,
+                                        dl.queued)) |
+                       color(Color::Green);
+              }(),
               text(fmt::format(" {} Tracks ",
                                current_source == PlaylistSource::Search
                                    ? track_data.size()
@@ -1643,6 +1659,21 @@ int main(int argc, char *argv[]) {
     });
   });
 
-  screen.Loop(renderer);
+  frame_scheduler.set_max_fps(config->get_max_fps());
+  frame_scheduler.set_probe([] {
+    return player->is_playing_state()
+               ? static_cast<int64_t>(player->get_position())
+               : int64_t{-1};
+  });
+  frame_scheduler.start();
+
+  startup_profile.mark("ui built");
+  screen->Loop(renderer);
+  startup_profile.report();
+  frame_scheduler.stop();
+  control_server.stop();
+  player->set_keep_callback(nullptr);
+  downloads.stop();
+  bandwidth.stop();
   return 0;
 }
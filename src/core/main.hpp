@@ -34,7 +34,6 @@ extern std::vector<Track> track_data_soundcloud;
 extern std::vector<Track> track_data_forestfm;
 extern std::string current_track;
 extern std::string current_artist;
-extern int current_track_index;
 
 extern Fetch fetch;
 extern SoundCloud soundcloud;
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Timings of startup phases for --profile-startup. Phases may run on any
+// thread and overlap; the report lists each with its start offset from
+// process start, its duration and whether it ran off the main thread.
+// Disabled, phase() costs a clock read.
+class StartupProfiler {
+public:
+  using Clock = std::chrono::steady_clock;
+
+private:
+  struct Phase {
+    std::string name;
+    Clock::time_point start;
+    Clock::time_point end;
+    bool background;
+  };
+
+  Clock::time_point origin = Clock::now();
+  std::thread::id main_thread = std::this_thread::get_id();
+  bool enabled = false;
+  std::mutex phase_mutex;
+  std::vector<Phase> phases;
+
+  static double ms(Clock::duration d) {
+    return std::chrono::duration<double, std::milli>(d).count();
+  }
+
+public:
+  // Records from construction to destruction
+  class Scope {
+  private:
+    StartupProfiler *profiler;
+    std::string name;
+    Clock::time_point start = Clock::now();
+
+  public:
+    Scope(StartupProfiler *p, std::string n) : profiler(p), name(std::move(n)) {}
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+    ~Scope() { profiler->record(name, start, Clock::now()); }
+  };
+
+  void enable() { enabled = true; }
+  bool is_enabled() const { return enabled; }
+
+  Scope phase(std::string name) { return Scope(this, std::move(name)); }
+
+  // A point in time, e.g. the first frame drawn
+  void mark(const std::string &name) {
+    auto now = Clock::now();
+    record(name, now, now);
+  }
+
+  void record(const std::string &name, Clock::time_point start, Clock::time_point end) {
+    if (!enabled) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(phase_mutex);
+    phases.push_back({name, start, end, std::this_thread::get_id() != main_thread});
+  }
+
+  // Printed to stderr, after the UI has given the terminal back
+  void report() {
+    if (!enabled) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(phase_mutex);
+    std::sort(phases.begin(), phases.end(),
+              [](const Phase &a, const Phase &b) { return a.start < b.start; });
+    fprintf(stderr, "startup profile (ms since process start)\n");
+    fprintf(stderr, "  %9s %9s  %s\n", "start", "took", "phase");
+    for (const auto &p : phases) {
+      fprintf(stderr, "  %9.1f %9.1f  %s%s\n", ms(p.start - origin), ms(p.end - p.start),
+              p.name.c_str(), p.background ? "  [bg]" : "");
+    }
+  }
+};
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <ftxui/dom/node.hpp>
+#include <ftxui/screen/box.hpp>
+#include <ftxui/screen/color.hpp>
+#include <ftxui/screen/screen.hpp>
+
+// Visualizer bars as a single FTXUI node that writes glyphs and colors
+// straight into the Screen cells of its box. One instance lives for the
+// whole session and is returned into every frame's tree, so drawing the
+// bars allocates nothing: glyphs are short enough for std::string's
+// inline storage and the frame is read through a shared_ptr.
+//
+// Blocks style draws one bar per two columns with eighth blocks (eight
+// steps per row); braille draws two bars per column with dots (four steps
+// per row). Unless a fixed bar count is set, the node asks for as many
+// bars as fit its width whenever that changes.
+class VisualizerBars : public ftxui::Node {
+public:
+  enum class Style { Blocks, Braille };
+
+  using FrameSource = std::function<std::shared_ptr<const std::vector<double>>()>;
+
+private:
+  FrameSource source;
+  std::function<void(int)> request_bars;
+  Style style;
+  int fixed_bars; // 0 = fit to width
+  int requested_bars = 0;
+  // Drawn before the first frame: just the base line; resized with the box
+  std::vector<double> idle_levels;
+
+  static constexpr int HEIGHT = 8; // rows
+  static constexpr int MIN_WIDTH = 16;
+
+  static constexpr const char *EIGHTHS[9] = {" ", "▁", "▂", "▃", "▄", "▅", "▆", "▇", "█"};
+  // Braille dot bits from the bottom row up, left and right columns
+  static constexpr uint8_t LEFT_DOTS[4] = {0x40, 0x04, 0x02, 0x01};
+  static constexpr uint8_t RIGHT_DOTS[4] = {0x80, 0x20, 0x10, 0x08};
+
+  static ftxui::Color color_for(double level) {
+    if (level <= 1.0 / 3.0) {
+      return ftxui::Color::Green;
+    }
+    return level <= 2.0 / 3.0 ? ftxui::Color::Yellow : ftxui::Color::Red;
+  }
+
+  // UTF-8 for U+2800 + bits, written into the cell without allocating
+  static void set_braille(ftxui::Pixel &pixel, uint8_t bits) {
+    char glyph[4] = {'\xE2', static_cast<char>(0xA0 | (bits >> 6)),
+                     static_cast<char>(0x80 | (bits & 0x3F)), '\0'};
+    pixel.character.assign(glyph, 3);
+  }
+
+  int bars_for_width(int width) const {
+    return style == Style::Braille ? width * 2 : width / 2;
+  }
+
+  void render_blocks(ftxui::Screen &screen, const std::vector<double> &levels, int x0) {
+    const int bottom = box_.y_max;
+    // A box cut shorter than the bars by the layout loses their tops
+    const int rows = std::min(HEIGHT, bottom - box_.y_min + 1);
+    for (size_t i = 0; i < levels.size(); i++) {
+      int x = x0 + static_cast<int>(i) * 2;
+      if (x > box_.x_max) {
+        break;
+      }
+      double level = std::clamp(levels[i], 0.0, 1.0);
+      int eighths = static_cast<int>(level * HEIGHT * 8);
+      ftxui::Color bar_color = color_for(level);
+      for (int row = 0; row < rows; row++) {
+        ftxui::Pixel &pixel = screen.PixelAt(x, bottom - row);
+        int fill = std::clamp(eighths - row * 8, 0, 8);
+        if (fill == 0 && row == 0) {
+          // Base indicator, always visible
+          pixel.character = EIGHTHS[1];
+          pixel.foreground_color = ftxui::Color::GrayDark;
+        } else {
+          pixel.character = EIGHTHS[fill];
+          pixel.foreground_color = bar_color;
+        }
+      }
+    }
+  }
+
+  void render_braille(ftxui::Screen &screen, const std::vector<double> &levels, int x0) {
+    const int bottom = box_.y_max;
+    const int rows = std::min(HEIGHT, bottom - box_.y_min + 1);
+    for (size_t i = 0; i < levels.size(); i += 2) {
+      int x = x0 + static_cast<int>(i / 2);
+      if (x > box_.x_max) {
+        break;
+      }
+      double left = std::clamp(levels[i], 0.0, 1.0);
+      double right = i + 1 < levels.size() ? std::clamp(levels[i + 1], 0.0, 1.0) : 0.0;
+      int left_dots = static_cast<int>(left * HEIGHT * 4);
+      int right_dots = static_cast<int>(right * HEIGHT * 4);
+      ftxui::Color bar_color = color_for(std::max(left, right));
+      for (int row = 0; row < rows; row++) {
+        uint8_t bits = 0;
+        int l = std::clamp(left_dots - row * 4, 0, 4);
+        int r = std::clamp(right_dots - row * 4, 0, 4);
+        for (int d = 0; d < l; d++) {
+          bits |= LEFT_DOTS[d];
+        }
+        for (int d = 0; d < r; d++) {
+          bits |= RIGHT_DOTS[d];
+        }
+        ftxui::Pixel &pixel = screen.PixelAt(x, bottom - row);
+        if (bits == 0 && row == 0) {
+          // Base indicator, always visible
+          set_braille(pixel, LEFT_DOTS[0] | RIGHT_DOTS[0]);
+          pixel.foreground_color = ftxui::Color::GrayDark;
+        } else {
+          set_braille(pixel, bits);
+          pixel.foreground_color = bar_color;
+        }
+      }
+    }
+  }
+
+public:
+  VisualizerBars(FrameSource source, std::function<void(int)> request_bars, Style style,
+                 int fixed_bars)
+      : source(std::move(source)), request_bars(std::move(request_bars)), style(style),
+        fixed_bars(fixed_bars) {}
+
+  static Style parse_style(const std::string &name) {
+    return name == "braille" ? Style::Braille : Style::Blocks;
+  }
+
+  void ComputeRequirement() override {
+    requirement_.min_x = MIN_WIDTH;
+    requirement_.min_y = HEIGHT;
+    requirement_.flex_grow_x = 1;
+    requirement_.flex_shrink_x = 1;
+    requirement_.flex_grow_y = 0;
+    requirement_.flex_shrink_y = 0;
+  }
+
+  void SetBox(ftxui::Box box) override {
+    Node::SetBox(box);
+    int bars = fixed_bars > 0 ? fixed_bars : std::max(1, bars_for_width(box.x_max - box.x_min + 1));
+    if (bars != static_cast<int>(idle_levels.size())) {
+      idle_levels.assign(bars, 0.0);
+    }
+    if (fixed_bars == 0 && request_bars && bars != requested_bars) {
+      requested_bars = bars;
+      request_bars(bars);
+    }
+  }
+
+  void Render(ftxui::Screen &screen) override {
+    auto frame = source ? source() : nullptr;
+    const std::vector<double> &levels = frame && !frame->empty() ? *frame : idle_levels;
+
+    // Centre the bars in the box
+    int width = box_.x_max - box_.x_min + 1;
+    int used = style == Style::Braille ? static_cast<int>((levels.size() + 1) / 2)
+                                       : static_cast<int>(levels.size()) * 2;
+    int x0 = box_.x_min + std::max(0, (width - used) / 2);
+
+    if (style == Style::Braille) {
+      render_braille(screen, levels, x0);
+    } else {
+      render_blocks(screen, levels, x0);
+    }
+  }
+};
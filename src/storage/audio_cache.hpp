@@ -0,0 +1,241 @@
+#pragma once
+
+#include "../common/Track.h"
+#include "../common/notification.hpp"
+#include "../common/paths.hpp"
+#include "rapidjson/document.h"
+#include "rapidjson/filereadstream.h"
+#include "rapidjson/filewritestream.h"
+#include "rapidjson/writer.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Persistent cache of streamed audio. The player records the stream to
+// "<hash>.part.mka" while it plays (mpv stream-record) and commits it here once
+// the track has played through; later plays load the local file instead.
+// Files are named by a hash of the track key and evicted least recently
+// used first once the total exceeds the size limit.
+class AudioCache {
+private:
+  struct Entry {
+    std::string file; // name inside dir
+    uint64_t size = 0;
+    int64_t last_used = 0; // unix seconds
+  };
+
+  std::string dir;
+  uint64_t max_bytes;
+  uint64_t total_bytes = 0;
+  std::unordered_map<std::string, Entry> entries; // track key -> entry
+  mutable std::mutex cache_mutex;
+
+  static constexpr const char *EXTENSION = ".mka";
+
+  static int64_t now_seconds() {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+  }
+
+  // FNV-1a; only needs to spread keys over file names
+  static std::string hash_key(const std::string &key) {
+    uint64_t h = 14695981039346656037ULL;
+    for (unsigned char c : key) {
+      h ^= c;
+      h *= 1099511628211ULL;
+    }
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(h));
+    return buf;
+  }
+
+  std::string index_path() const { return dir + "/index.json"; }
+
+  // Caller holds cache_mutex
+  void load_index() {
+    FILE *in = fopen(index_path().c_str(), "rb");
+    if (in) {
+      char read_buffer[65536];
+      rapidjson::FileReadStream is(in, read_buffer, sizeof(read_buffer));
+      rapidjson::Document doc;
+      doc.ParseStream(is);
+      fclose(in);
+
+      if (!doc.HasParseError() && doc.IsObject() && doc.HasMember("entries") &&
+          doc["entries"].IsArray()) {
+        for (const auto &item : doc["entries"].GetArray()) {
+          if (!item.IsObject() || !item.HasMember("key") || !item["key"].IsString() ||
+              !item.HasMember("file") || !item["file"].IsString()) {
+            continue;
+          }
+          Entry entry;
+          entry.file = item["file"].GetString();
+          entry.last_used = item.HasMember("last_used") && item["last_used"].IsInt64()
+                                ? item["last_used"].GetInt64()
+                                : 0;
+
+          // Files removed behind our back drop out of the index
+          std::error_code ec;
+          auto size = std::filesystem::file_size(dir + "/" + entry.file, ec);
+          if (ec) {
+            continue;
+          }
+          entry.size = size;
+          total_bytes += size;
+          entries[item["key"].GetString()] = entry;
+        }
+      }
+    }
+
+    // Recordings interrupted by a crash or quit are never resumed
+    std::error_code ec;
+    for (const auto &file : std::filesystem::directory_iterator(dir, ec)) {
+      if (file.path().stem().extension() == ".part") {
+        std::filesystem::remove(file.path(), ec);
+      }
+    }
+  }
+
+  // Caller holds cache_mutex. Written to a temp file and renamed so a crash
+  // never leaves a truncated index.
+  void save_index() const {
+    rapidjson::Document doc;
+    doc.SetObject();
+    auto &allocator = doc.GetAllocator();
+
+    rapidjson::Value list(rapidjson::kArrayType);
+    for (const auto &[key, entry] : entries) {
+      rapidjson::Value item(rapidjson::kObjectType);
+      item.AddMember("key", rapidjson::StringRef(key.c_str()), allocator);
+      item.AddMember("file", rapidjson::StringRef(entry.file.c_str()), allocator);
+      item.AddMember("size", entry.size, allocator);
+      item.AddMember("last_used", entry.last_used, allocator);
+      list.PushBack(item, allocator);
+    }
+    doc.AddMember("entries", list, allocator);
+
+    std::string tmp = index_path() + ".tmp";
+    FILE *out = fopen(tmp.c_str(), "wb");
+    if (!out) {
+      notifications::send("Failed to write audio cache index");
+      return;
+    }
+    char write_buffer[65536];
+    rapidjson::FileWriteStream os(out, write_buffer, sizeof(write_buffer));
+    rapidjson::Writer<rapidjson::FileWriteStream> writer(os);
+    doc.Accept(writer);
+    fclose(out);
+
+    std::error_code ec;
+    std::filesystem::rename(tmp, index_path(), ec);
+  }
+
+  // Caller holds cache_mutex. Drops least recently used entries until the
+  // total fits, never touching `keep`.
+  void evict(const std::string &keep) {
+    while (total_bytes > max_bytes && entries.size() > 1) {
+      auto victim = entries.end();
+      for (auto it = entries.begin(); it != entries.end(); ++it) {
+        if (it->first != keep &&
+            (victim == entries.end() || it->second.last_used < victim->second.last_used)) {
+          victim = it;
+        }
+      }
+      if (victim == entries.end()) {
+        break;
+      }
+      std::error_code ec;
+      std::filesystem::remove(dir + "/" + victim->second.file, ec);
+      total_bytes -= victim->second.size;
+      entries.erase(victim);
+    }
+  }
+
+public:
+  AudioCache(const std::string &cache_dir, int max_size_mb)
+      : dir(cache_dir + "/audio"),
+        max_bytes(static_cast<uint64_t>(std::max(max_size_mb, 1)) * 1024 * 1024) {
+    paths::ensure_directory_exists(dir);
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    load_index();
+    evict("");
+  }
+
+  // Stable identity of a track across sessions. Stream URLs from some
+  // sources expire, so the source id is preferred when there is one.
+  static std::string key_for(const Track &track) {
+    if (!track.id.empty()) {
+      return track.source + ":" + track.id;
+    }
+    return track.url;
+  }
+
+  // Local file for `key`, if cached; marks it as recently used
+  std::optional<std::string> lookup(const std::string &key) {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto it = entries.find(key);
+    if (it == entries.end()) {
+      return std::nullopt;
+    }
+    std::string path = dir + "/" + it->second.file;
+    if (!std::filesystem::exists(path)) {
+      total_bytes -= it->second.size;
+      entries.erase(it);
+      save_index();
+      return std::nullopt;
+    }
+    it->second.last_used = now_seconds();
+    save_index();
+    return path;
+  }
+
+  // Where to record a stream for `key` while it plays
+  std::string part_path(const std::string &key) const {
+    return dir + "/" + hash_key(key) + ".part" + EXTENSION;
+  }
+
+  // Move a finished recording into the cache
+  bool commit(const std::string &key, const std::string &part) {
+    std::error_code ec;
+    auto size = std::filesystem::file_size(part, ec);
+    if (ec || size == 0) {
+      discard(part);
+      return false;
+    }
+
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    std::string file = hash_key(key) + EXTENSION;
+    std::filesystem::rename(part, dir + "/" + file, ec);
+    if (ec) {
+      discard(part);
+      return false;
+    }
+
+    auto it = entries.find(key);
+    if (it != entries.end()) {
+      total_bytes -= it->second.size;
+    }
+    entries[key] = Entry{file, size, now_seconds()};
+    total_bytes += size;
+    evict(key);
+    save_index();
+    return true;
+  }
+
+  void discard(const std::string &part) {
+    std::error_code ec;
+    std::filesystem::remove(part, ec);
+  }
+
+  uint64_t size_bytes() const {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    return total_bytes;
+  }
+};
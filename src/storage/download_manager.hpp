@@ -0,0 +1,732 @@
+#pragma once
+
+#include "../common/Track.h"
+#include "../common/notification.hpp"
+#include "../common/paths.hpp"
+#include "segmented_downloader.hpp"
+#include "../core/bandwidth_arbiter.hpp"
+#include "rapidjson/document.h"
+#include "rapidjson/filereadstream.h"
+#include "rapidjson/filewritestream.h"
+#include "rapidjson/writer.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+struct DownloadJob {
+  enum class Status { Queued, Running, Done, Failed };
+
+  uint64_t id = 0;
+  Track track;
+  std::string output; // final file path
+  std::string format; // audio format handed to yt-dlp
+  Status status = Status::Queued;
+  double progress = 0.0; // percent
+  int attempts = 0;
+  std::string error;
+
+  // Keep mode: audio already on disk. The whole track, or its head when
+  // `partial`, with the rest still to be fetched from stream_url (the
+  // media the player resolved the track to) or a direct track.url.
+  std::string local_file;
+  bool partial = false;
+  std::string stream_url;
+
+  // Retry backoff: not handed to a worker before this time
+  std::chrono::steady_clock::time_point not_before{};
+};
+
+// Download queue worked by a fixed pool of threads. Direct media URLs are
+// fetched natively (SegmentedDownloader) and remuxed with ffmpeg; anything
+// else goes through yt-dlp, run directly (fork/exec, no shell) with its
+// progress lines parsed. Unfinished jobs are saved to disk and picked up
+// again on the next start; yt-dlp resumes their partial files.
+class DownloadManager {
+private:
+  std::string state_file;
+  int worker_count;
+  int connections; // per native download
+  bool transcode;  // native downloads re-encode to the job format
+  static constexpr int MAX_ATTEMPTS = 3;
+
+  mutable std::mutex jobs_mutex;
+  std::condition_variable jobs_cv;
+  std::vector<DownloadJob> jobs;
+  uint64_t next_id = 1;
+  // Running child processes. Network ones (yt-dlp) are paused with
+  // SIGSTOP while the arbiter throttles, since their rate can't be changed
+  // from outside.
+  struct Child {
+    pid_t pid;
+    bool network;
+  };
+  std::vector<Child> children;
+
+  BandwidthArbiter *arbiter = nullptr;
+
+  std::vector<std::thread> workers;
+  std::atomic_bool running{false};
+
+  std::function<void()> on_change;
+  std::function<void(const DownloadJob &)> on_complete;
+
+  void changed() {
+    if (on_change) {
+      on_change();
+    }
+  }
+
+  // Caller holds jobs_mutex. Only unfinished jobs are kept.
+  void save() const {
+    rapidjson::Document doc;
+    doc.SetObject();
+    auto &allocator = doc.GetAllocator();
+
+    rapidjson::Value list(rapidjson::kArrayType);
+    for (const auto &job : jobs) {
+      if (job.status != DownloadJob::Status::Queued &&
+          job.status != DownloadJob::Status::Running) {
+        continue;
+      }
+      rapidjson::Value item(rapidjson::kObjectType);
+      item.AddMember("name", rapidjson::StringRef(job.track.name.c_str()), allocator);
+      item.AddMember("artist", rapidjson::StringRef(job.track.artist.c_str()), allocator);
+      item.AddMember("url", rapidjson::StringRef(job.track.url.c_str()), allocator);
+      item.AddMember("id", rapidjson::StringRef(job.track.id.c_str()), allocator);
+      item.AddMember("source", rapidjson::StringRef(job.track.source.c_str()), allocator);
+      item.AddMember("output", rapidjson::StringRef(job.output.c_str()), allocator);
+      item.AddMember("format", rapidjson::StringRef(job.format.c_str()), allocator);
+      item.AddMember("attempts", job.attempts, allocator);
+      item.AddMember("local_file", rapidjson::StringRef(job.local_file.c_str()), allocator);
+      item.AddMember("partial", job.partial, allocator);
+      item.AddMember("stream_url", rapidjson::StringRef(job.stream_url.c_str()), allocator);
+      list.PushBack(item, allocator);
+    }
+    doc.AddMember("jobs", list, allocator);
+
+    std::string tmp = state_file + ".tmp";
+    FILE *out = fopen(tmp.c_str(), "wb");
+    if (!out) {
+      notifications::send("Failed to save download queue");
+      return;
+    }
+    char write_buffer[65536];
+    rapidjson::FileWriteStream os(out, write_buffer, sizeof(write_buffer));
+    rapidjson::Writer<rapidjson::FileWriteStream> writer(os);
+    doc.Accept(writer);
+    fclose(out);
+
+    std::error_code ec;
+    std::filesystem::rename(tmp, state_file, ec);
+  }
+
+  // Caller holds jobs_mutex
+  void load() {
+    FILE *in = fopen(state_file.c_str(), "rb");
+    if (!in) {
+      return;
+    }
+    char read_buffer[65536];
+    rapidjson::FileReadStream is(in, read_buffer, sizeof(read_buffer));
+    rapidjson::Document doc;
+    doc.ParseStream(is);
+    fclose(in);
+
+    if (doc.HasParseError() || !doc.IsObject() || !doc.HasMember("jobs") ||
+        !doc["jobs"].IsArray()) {
+      return;
+    }
+
+    auto get = [](const rapidjson::Value &item, const char *key) -> std::string {
+      return item.HasMember(key) && item[key].IsString() ? item[key].GetString() : "";
+    };
+    for (const auto &item : doc["jobs"].GetArray()) {
+      if (!item.IsObject()) {
+        continue;
+      }
+      DownloadJob job;
+      job.id = next_id++;
+      job.track.name = get(item, "name");
+      job.track.artist = get(item, "artist");
+      job.track.url = get(item, "url");
+      job.track.id = get(item, "id");
+      job.track.source = get(item, "source");
+      job.output = get(item, "output");
+      job.format = get(item, "format");
+      job.local_file = get(item, "local_file");
+      job.partial = item.HasMember("partial") && item["partial"].IsBool() &&
+                    item["partial"].GetBool();
+      job.stream_url = get(item, "stream_url");
+      job.attempts = item.HasMember("attempts") && item["attempts"].IsInt()
+                         ? item["attempts"].GetInt()
+                         : 0;
+      if (job.track.url.empty() || job.output.empty()) {
+        continue;
+      }
+      if (job.format.empty()) {
+        job.format = "mp3";
+      }
+      jobs.push_back(job);
+    }
+  }
+
+  DownloadJob *find(uint64_t id) {
+    for (auto &job : jobs) {
+      if (job.id == id) {
+        return &job;
+      }
+    }
+    return nullptr;
+  }
+
+  // Caller holds jobs_mutex
+  DownloadJob *next_ready() {
+    auto now = std::chrono::steady_clock::now();
+    for (auto &job : jobs) {
+      if (job.status == DownloadJob::Status::Queued && job.not_before <= now) {
+        return &job;
+      }
+    }
+    return nullptr;
+  }
+
+  void worker_loop() {
+    while (running) {
+      DownloadJob job;
+      {
+        std::unique_lock<std::mutex> lock(jobs_mutex);
+        DownloadJob *it = nullptr;
+        // Timed wait so jobs in backoff become ready without a notify
+        while (running && !(it = next_ready())) {
+          jobs_cv.wait_for(lock, std::chrono::seconds(1));
+        }
+        if (!running) {
+          return;
+        }
+        it->status = DownloadJob::Status::Running;
+        it->attempts++;
+        job = *it;
+        save();
+      }
+      changed();
+
+      std::string error;
+      std::string output;
+      bool ok = run_job(job, output, error);
+
+      bool retry = false;
+      {
+        std::lock_guard<std::mutex> lock(jobs_mutex);
+        DownloadJob *current = find(job.id);
+        if (!current) {
+          continue;
+        }
+        if (ok) {
+          current->status = DownloadJob::Status::Done;
+          current->progress = 100.0;
+          current->output = output;
+        } else if (!running) {
+          // Interrupted by shutdown; resumes on the next start
+          current->status = DownloadJob::Status::Queued;
+          current->attempts--;
+        } else if (current->attempts < MAX_ATTEMPTS) {
+          current->status = DownloadJob::Status::Queued;
+          current->not_before = std::chrono::steady_clock::now() +
+                                std::chrono::seconds(2 << current->attempts);
+          retry = true;
+        } else {
+          current->status = DownloadJob::Status::Failed;
+          current->error = error;
+          // A failed job is not saved, so nothing would ever clean it up
+          std::error_code ec;
+          std::filesystem::remove(current->local_file, ec);
+        }
+        save();
+      }
+      changed();
+
+      if (ok) {
+        job.output = output;
+        if (on_complete) {
+          on_complete(job);
+        }
+        notifications::send_download_complete(output);
+      } else if (running && !retry) {
+        notifications::send_download_failed(job.track.name + ": " + error);
+      }
+    }
+  }
+
+  void set_progress(uint64_t id, double percent) {
+    {
+      std::lock_guard<std::mutex> lock(jobs_mutex);
+      if (DownloadJob *current = find(id)) {
+        current->progress = percent;
+      }
+    }
+    changed();
+  }
+
+  // Runs args[0] without a shell, passing each output line (stdout and
+  // stderr) to on_line. Returns the exit code, 127 when the program is
+  // missing, or -1 when it could not be started or was killed.
+  int run_process(std::vector<std::string> args, bool network,
+                  const std::function<void(const std::string &)> &on_line) {
+    std::vector<char *> argv;
+    for (auto &arg : args) {
+      argv.push_back(arg.data());
+    }
+    argv.push_back(nullptr);
+
+    // Close-on-exec, so children other workers fork at the same time do
+    // not hold our write end open; dup2 clears it on the child's stdio
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+      return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+      close(fds[0]);
+      close(fds[1]);
+      return -1;
+    }
+    if (pid == 0) {
+      // Child: only async-signal-safe calls until exec
+      dup2(fds[1], STDOUT_FILENO);
+      dup2(fds[1], STDERR_FILENO);
+      close(fds[0]);
+      close(fds[1]);
+      int devnull = open("/dev/null", O_RDONLY | O_CLOEXEC);
+      if (devnull >= 0) {
+        dup2(devnull, STDIN_FILENO);
+      }
+      execvp(argv[0], argv.data());
+      _exit(127);
+    }
+
+    close(fds[1]);
+    {
+      std::lock_guard<std::mutex> lock(jobs_mutex);
+      children.push_back({pid, network});
+      // stop() may have swept the children just before this one started
+      if (!running) {
+        kill(pid, SIGTERM);
+      } else if (network && arbiter && arbiter->is_throttled()) {
+        kill(pid, SIGSTOP);
+      }
+    }
+
+    FILE *out = fdopen(fds[0], "r");
+    char line[1024];
+    while (out && fgets(line, sizeof(line), out)) {
+      std::string text(line);
+      while (!text.empty() && (text.back() == '\n' || text.back() == '\r')) {
+        text.pop_back();
+      }
+      if (!text.empty()) {
+        on_line(text);
+      }
+    }
+    if (out) {
+      fclose(out);
+    } else {
+      close(fds[0]);
+    }
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    {
+      std::lock_guard<std::mutex> lock(jobs_mutex);
+      children.erase(std::remove_if(children.begin(), children.end(),
+                                    [pid](const Child &c) { return c.pid == pid; }),
+                     children.end());
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+  }
+
+  // Extracts and converts the audio with yt-dlp; works for any URL
+  // yt-dlp understands
+  bool run_ytdlp(const DownloadJob &job, std::string &output, std::string &error) {
+    std::string last_line;
+    int code = run_process(
+        {"yt-dlp", "--newline", "--no-playlist", "--continue", "-x",
+         "--audio-format", job.format, "-o", job.output, job.track.url},
+        true, [&](const std::string &text) {
+          double percent;
+          if (text.rfind("[download]", 0) == 0 &&
+              sscanf(text.c_str() + 10, " %lf%%", &percent) == 1) {
+            set_progress(job.id, percent);
+          } else {
+            last_line = text;
+          }
+        });
+
+    if (code == 0) {
+      output = job.output;
+      return true;
+    }
+    error = code == 127 ? "yt-dlp not found"
+                        : (last_line.empty() ? "yt-dlp failed" : last_line);
+    return false;
+  }
+
+  // Container to remux into for a source file extension
+  static std::string remux_extension(const std::string &ext) {
+    if (ext == "mp4" || ext == "m4a" || ext == "aac") {
+      return "m4a";
+    }
+    if (ext == "webm" || ext == "opus") {
+      return "opus";
+    }
+    return ext;
+  }
+
+  // Container for a codec name as reported by ffprobe
+  static std::string codec_extension(const std::string &codec) {
+    if (codec == "aac") {
+      return "m4a";
+    }
+    if (codec == "opus" || codec == "mp3" || codec == "flac") {
+      return codec;
+    }
+    if (codec == "vorbis") {
+      return "ogg";
+    }
+    return "mka";
+  }
+
+  // One value from ffprobe, e.g. entry "format=duration"
+  std::string ffprobe(const std::string &path, const std::string &entry) {
+    std::string value;
+    int code = run_process({"ffprobe", "-v", "error", "-select_streams", "a:0",
+                            "-show_entries", entry, "-of", "csv=p=0", path},
+                           false, [&](const std::string &text) { value = text; });
+    return code == 0 ? value : "";
+  }
+
+  // Runs ffmpeg with `inputs` (everything before the output options) into
+  // output, copying the audio unless downloads.transcode is set and
+  // `final` (intermediate files always keep the source codec). Returns
+  // ffmpeg's exit code.
+  int ffmpeg(std::vector<std::string> inputs, const DownloadJob &job,
+             const std::string &output, std::string &error, bool final = true) {
+    std::vector<std::string> args = {"ffmpeg", "-y", "-loglevel", "error"};
+    args.insert(args.end(), inputs.begin(), inputs.end());
+    args.push_back("-vn");
+    if (!transcode || !final) {
+      args.insert(args.end(), {"-c:a", "copy"});
+    }
+    args.insert(args.end(), {"-metadata", "title=" + job.track.name,
+                             "-metadata", "artist=" + job.track.artist, output});
+
+    std::string last_line;
+    int code = run_process(args, false, [&](const std::string &text) { last_line = text; });
+    if (code != 0) {
+      error = code == 127 ? "ffmpeg not found"
+                          : (last_line.empty() ? "ffmpeg failed" : last_line);
+    }
+    return code;
+  }
+
+  static std::string base_of(const DownloadJob &job) {
+    return std::filesystem::path(job.output).replace_extension().string();
+  }
+
+  // Fetches a direct media URL with parallel range requests, then remuxes
+  // it with ffmpeg without re-encoding (or transcodes to job.format when
+  // downloads.transcode is set)
+  bool run_native(const DownloadJob &job, std::string &output, std::string &error) {
+    std::string url_path = job.track.url.substr(0, job.track.url.find_first_of("?#"));
+    std::string source_ext = SegmentedDownloader::extension_of(url_path);
+    std::string base = base_of(job);
+    std::string part = base + ".part";
+
+    // The fetch is most of the work; remuxing takes the last few percent
+    SegmentedDownloader downloader(connections);
+    if (arbiter) {
+      arbiter->register_transfer();
+      downloader.set_rate_limit([this] { return arbiter->transfer_limit(); });
+    }
+    bool fetched = downloader.download(
+        job.track.url, part, running,
+        [&](double percent) { set_progress(job.id, percent * 0.95); }, error);
+    if (arbiter) {
+      arbiter->unregister_transfer();
+    }
+    if (!fetched) {
+      return false;
+    }
+
+    output = base + "." + (transcode ? job.format : remux_extension(source_ext));
+    int code = ffmpeg({"-i", part}, job, output, error);
+    std::error_code ec;
+    if (code == 127 && !transcode) {
+      // No ffmpeg: keep the file in the container it came in
+      output = base + "." + (source_ext.empty() ? "audio" : source_ext);
+      std::filesystem::rename(part, output, ec);
+      return !ec;
+    }
+    std::filesystem::remove(part, ec);
+    return code == 0;
+  }
+
+  // Keep mode, whole track recorded while it played: only a remux remains
+  bool run_kept(const DownloadJob &job, std::string &output, std::string &error) {
+    std::string codec = ffprobe(job.local_file, "stream=codec_name");
+    output = base_of(job) + "." + (transcode ? job.format : codec_extension(codec));
+    if (ffmpeg({"-i", job.local_file}, job, output, error) != 0) {
+      return false;
+    }
+    std::error_code ec;
+    std::filesystem::remove(job.local_file, ec);
+    return true;
+  }
+
+  // Keep mode, track skipped midway: fetch only what comes after the
+  // recorded head from `source`, then join the two. Cuts land on packet
+  // boundaries, which for audio are a few milliseconds apart.
+  bool run_kept_tail(const DownloadJob &job, const std::string &source, std::string &output,
+                     std::string &error) {
+    double recorded = std::atof(ffprobe(job.local_file, "format=duration").c_str());
+    std::string codec = ffprobe(job.local_file, "stream=codec_name");
+    if (recorded <= 0 || codec.empty()) {
+      error = "recorded part is unreadable";
+      return false;
+    }
+
+    std::string base = base_of(job);
+    std::string tail = base + ".tail.mka";
+    std::string list = base + ".concat.txt";
+    // Same codec as the head, so the two join without re-encoding; any
+    // transcode happens once, on the joined file
+    if (ffmpeg({"-ss", std::to_string(recorded), "-i", source}, job, tail, error, false) != 0) {
+      std::error_code ec;
+      std::filesystem::remove(tail, ec);
+      return false;
+    }
+    set_progress(job.id, 90.0);
+
+    // concat demuxer list; single quotes in paths are escaped as '\''
+    auto quote = [](const std::string &path) {
+      std::string out = "'";
+      for (char c : path) {
+        out += c == '\'' ? std::string("'\\''") : std::string(1, c);
+      }
+      return out + "'";
+    };
+    FILE *f = fopen(list.c_str(), "w");
+    if (!f) {
+      error = "cannot write " + list;
+      std::error_code ec;
+      std::filesystem::remove(tail, ec);
+      return false;
+    }
+    fprintf(f, "file %s\nfile %s\n", quote(job.local_file).c_str(), quote(tail).c_str());
+    fclose(f);
+
+    output = base + "." + (transcode ? job.format : codec_extension(codec));
+    bool ok = ffmpeg({"-f", "concat", "-safe", "0", "-i", list}, job, output, error) == 0;
+
+    std::error_code ec;
+    std::filesystem::remove(tail, ec);
+    std::filesystem::remove(list, ec);
+    if (ok) {
+      std::filesystem::remove(job.local_file, ec);
+    }
+    return ok;
+  }
+
+  bool run_job(const DownloadJob &job, std::string &output, std::string &error) {
+    bool direct = SegmentedDownloader::is_direct_media_url(job.track.url);
+    if (!job.local_file.empty() && std::filesystem::exists(job.local_file)) {
+      if (!job.partial) {
+        return run_kept(job, output, error);
+      }
+      std::string source = !job.stream_url.empty() ? job.stream_url : direct ? job.track.url : "";
+      if (!source.empty()) {
+        if (run_kept_tail(job, source, output, error)) {
+          return true;
+        }
+        if (!running) {
+          return false; // the head is used again on the next start
+        }
+      }
+      // Fall back to fetching the whole track; the head is of no more use
+      std::error_code ec;
+      std::filesystem::remove(job.local_file, ec);
+      error.clear();
+    }
+
+    if (direct) {
+      if (run_native(job, output, error)) {
+        return true;
+      }
+      if (!running) {
+        return false;
+      }
+      // Resolved URLs can expire; yt-dlp gets a chance to resolve it again
+    }
+    error.clear();
+    return run_ytdlp(job, output, error);
+  }
+
+public:
+  DownloadManager(const std::string &file, int workers, int connections_per_job = 4,
+                  bool transcode_native = false)
+      : state_file(file), worker_count(std::clamp(workers, 1, 8)),
+        connections(connections_per_job), transcode(transcode_native) {
+    paths::ensure_directory_exists(std::filesystem::path(state_file).parent_path().string());
+    std::lock_guard<std::mutex> lock(jobs_mutex);
+    load();
+  }
+
+  ~DownloadManager() { stop(); }
+
+  DownloadManager(const DownloadManager &) = delete;
+  DownloadManager &operator=(const DownloadManager &) = delete;
+
+  // Yield to playback: native transfers follow the arbiter's rate limit,
+  // yt-dlp children are paused while it throttles. Set before start().
+  void set_arbiter(BandwidthArbiter *bandwidth) {
+    arbiter = bandwidth;
+    arbiter->add_listener([this](bool throttled) {
+      std::lock_guard<std::mutex> lock(jobs_mutex);
+      for (const auto &child : children) {
+        if (child.network) {
+          kill(child.pid, throttled ? SIGSTOP : SIGCONT);
+        }
+      }
+    });
+  }
+
+  // Called from worker threads whenever a job changes
+  void set_change_callback(std::function<void()> callback) {
+    on_change = std::move(callback);
+  }
+
+  // Called from a worker thread for each finished job, output set to the
+  // file actually written
+  void set_complete_callback(std::function<void(const DownloadJob &)> callback) {
+    on_complete = std::move(callback);
+  }
+
+  void start() {
+    if (running.exchange(true)) {
+      return;
+    }
+    for (int i = 0; i < worker_count; i++) {
+      workers.emplace_back([this] { worker_loop(); });
+    }
+  }
+
+  // Stops the workers and any running yt-dlp; unfinished jobs stay queued
+  // on disk.
+  void stop() {
+    if (!running.exchange(false)) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(jobs_mutex);
+      for (const auto &child : children) {
+        kill(child.pid, SIGTERM);
+        kill(child.pid, SIGCONT); // a stopped child only sees SIGTERM once resumed
+      }
+    }
+    jobs_cv.notify_all();
+    for (auto &worker : workers) {
+      if (worker.joinable()) {
+        worker.join();
+      }
+    }
+    workers.clear();
+    std::lock_guard<std::mutex> lock(jobs_mutex);
+    save();
+  }
+
+  // local_file: audio already recorded by keep mode, the whole track or
+  // (partial) its beginning; the job takes ownership of the file.
+  // stream_url: what the player actually opened for the track, where the
+  // rest of a partial recording is fetched from.
+  uint64_t enqueue(const Track &track, const std::string &output,
+                   const std::string &format, const std::string &local_file = "",
+                   bool partial = false, const std::string &stream_url = "") {
+    uint64_t id;
+    {
+      std::lock_guard<std::mutex> lock(jobs_mutex);
+      // Same file already queued or downloading
+      for (const auto &job : jobs) {
+        if (job.output == output && (job.status == DownloadJob::Status::Queued ||
+                                     job.status == DownloadJob::Status::Running)) {
+          return job.id;
+        }
+      }
+      DownloadJob job;
+      job.id = id = next_id++;
+      job.track = track;
+      job.output = output;
+      job.format = format;
+      job.local_file = local_file;
+      job.partial = partial;
+      job.stream_url = stream_url;
+      jobs.push_back(job);
+      save();
+    }
+    jobs_cv.notify_one();
+    changed();
+    return id;
+  }
+
+  std::vector<DownloadJob> get_jobs() const {
+    std::lock_guard<std::mutex> lock(jobs_mutex);
+    return jobs;
+  }
+
+  // Counts and mean progress of running jobs, for status lines
+  struct Summary {
+    int running = 0;
+    int queued = 0;
+    int failed = 0;
+    double progress = 0.0;
+  };
+
+  Summary summary() const {
+    std::lock_guard<std::mutex> lock(jobs_mutex);
+    Summary s;
+    for (const auto &job : jobs) {
+      switch (job.status) {
+      case DownloadJob::Status::Running:
+        s.running++;
+        s.progress += job.progress;
+        break;
+      case DownloadJob::Status::Queued:
+        s.queued++;
+        break;
+      case DownloadJob::Status::Failed:
+        s.failed++;
+        break;
+      default:
+        break;
+      }
+    }
+    if (s.running > 0) {
+      s.progress /= s.running;
+    }
+    return s;
+  }
+};
@@ -0,0 +1,202 @@
+#pragma once
+
+#include "../common/Track.h"
+#include "../common/notification.hpp"
+#include "rapidjson/document.h"
+#include "rapidjson/filereadstream.h"
+#include "rapidjson/filewritestream.h"
+#include "rapidjson/writer.h"
+#include <cctype>
+#include <cstdio>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+// Index of tracks saved to the download directory, so playing one of them
+// loads the local file instead of streaming it. A track matches by source
+// and id, or failing that by normalized artist and title (the same song
+// found through another source).
+class LocalLibrary {
+private:
+  struct Entry {
+    Track track; // identity only: name, artist, source, id
+    std::string path;
+  };
+
+  std::string index_file;
+  std::unordered_map<std::string, Entry> entries;           // path -> entry
+  std::unordered_map<std::string, std::string> by_key;      // key -> path
+  mutable std::mutex library_mutex;
+
+  // Lower-case words of letters and digits, single spaces between
+  static std::string normalize(const std::string &text) {
+    std::string out;
+    bool gap = false;
+    for (unsigned char c : text) {
+      if (std::isalnum(c) || c >= 0x80) {
+        if (gap && !out.empty()) {
+          out += ' ';
+        }
+        out += static_cast<char>(std::tolower(c));
+        gap = false;
+      } else {
+        gap = true;
+      }
+    }
+    return out;
+  }
+
+  static std::string id_key(const Track &track) {
+    return track.id.empty() ? "" : "id:" + track.source + ":" + track.id;
+  }
+
+  static std::string title_key(const Track &track) {
+    std::string artist = normalize(track.artist);
+    std::string name = normalize(track.name);
+    return artist.empty() || name.empty() ? "" : "title:" + artist + "\n" + name;
+  }
+
+  // Caller holds library_mutex
+  void index(const Entry &entry) {
+    for (const auto &key : {id_key(entry.track), title_key(entry.track)}) {
+      if (!key.empty()) {
+        by_key[key] = entry.path;
+      }
+    }
+    entries[entry.path] = entry;
+  }
+
+  // Caller holds library_mutex
+  void forget(const std::string &path) {
+    auto it = entries.find(path);
+    if (it == entries.end()) {
+      return;
+    }
+    for (const auto &key : {id_key(it->second.track), title_key(it->second.track)}) {
+      auto k = by_key.find(key);
+      if (k != by_key.end() && k->second == path) {
+        by_key.erase(k);
+      }
+    }
+    entries.erase(it);
+  }
+
+  // Caller holds library_mutex
+  void load() {
+    FILE *in = fopen(index_file.c_str(), "rb");
+    if (!in) {
+      return;
+    }
+    char read_buffer[65536];
+    rapidjson::FileReadStream is(in, read_buffer, sizeof(read_buffer));
+    rapidjson::Document doc;
+    doc.ParseStream(is);
+    fclose(in);
+
+    if (doc.HasParseError() || !doc.IsObject() || !doc.HasMember("tracks") ||
+        !doc["tracks"].IsArray()) {
+      return;
+    }
+    auto get = [](const rapidjson::Value &item, const char *name) {
+      return item.HasMember(name) && item[name].IsString() ? std::string(item[name].GetString())
+                                                           : std::string();
+    };
+    for (const auto &item : doc["tracks"].GetArray()) {
+      if (!item.IsObject()) {
+        continue;
+      }
+      Entry entry;
+      entry.path = get(item, "path");
+      entry.track.name = get(item, "name");
+      entry.track.artist = get(item, "artist");
+      entry.track.source = get(item, "source");
+      entry.track.id = get(item, "id");
+      // Files deleted since drop out of the index
+      if (!entry.path.empty() && std::filesystem::exists(entry.path)) {
+        index(entry);
+      }
+    }
+  }
+
+  // Caller holds library_mutex
+  void save() const {
+    rapidjson::Document doc;
+    doc.SetObject();
+    auto &allocator = doc.GetAllocator();
+
+    rapidjson::Value list(rapidjson::kArrayType);
+    for (const auto &[path, entry] : entries) {
+      rapidjson::Value item(rapidjson::kObjectType);
+      item.AddMember("path", rapidjson::StringRef(path.c_str()), allocator);
+      item.AddMember("name", rapidjson::StringRef(entry.track.name.c_str()), allocator);
+      item.AddMember("artist", rapidjson::StringRef(entry.track.artist.c_str()), allocator);
+      item.AddMember("source", rapidjson::StringRef(entry.track.source.c_str()), allocator);
+      item.AddMember("id", rapidjson::StringRef(entry.track.id.c_str()), allocator);
+      list.PushBack(item, allocator);
+    }
+    doc.AddMember("tracks", list, allocator);
+
+    std::string tmp = index_file + ".tmp";
+    FILE *out = fopen(tmp.c_str(), "wb");
+    if (!out) {
+      notifications::send("Failed to save library index");
+      return;
+    }
+    char write_buffer[65536];
+    rapidjson::FileWriteStream os(out, write_buffer, sizeof(write_buffer));
+    rapidjson::Writer<rapidjson::FileWriteStream> writer(os);
+    doc.Accept(writer);
+    fclose(out);
+
+    std::error_code ec;
+    std::filesystem::rename(tmp, index_file, ec);
+  }
+
+public:
+  explicit LocalLibrary(const std::string &file) : index_file(file) {
+    std::lock_guard<std::mutex> lock(library_mutex);
+    load();
+  }
+
+  // Record a finished download
+  void add(const Track &track, const std::string &path) {
+    std::lock_guard<std::mutex> lock(library_mutex);
+    forget(path);
+    Entry entry;
+    entry.track.name = track.name;
+    entry.track.artist = track.artist;
+    entry.track.source = track.source;
+    entry.track.id = track.id;
+    entry.path = path;
+    index(entry);
+    save();
+  }
+
+  // Local copy of `track`, if one was downloaded and still exists
+  std::optional<std::string> resolve(const Track &track) {
+    std::lock_guard<std::mutex> lock(library_mutex);
+    for (const auto &key : {id_key(track), title_key(track)}) {
+      if (key.empty()) {
+        continue;
+      }
+      auto it = by_key.find(key);
+      if (it == by_key.end()) {
+        continue;
+      }
+      std::string path = it->second;
+      if (std::filesystem::exists(path)) {
+        return path;
+      }
+      forget(path);
+      save();
+    }
+    return std::nullopt;
+  }
+
+  size_t size() const {
+    std::lock_guard<std::mutex> lock(library_mutex);
+    return entries.size();
+  }
+};
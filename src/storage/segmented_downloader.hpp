@@ -0,0 +1,288 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <curl/curl.h>
+#include <fcntl.h>
+#include <functional>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// Fetches an already resolved media URL over several HTTP range requests
+// at once, each writing its slice straight into a preallocated file with
+// pwrite(). Servers without range support or a known length get a single
+// plain request.
+class SegmentedDownloader {
+public:
+  using ProgressFn = std::function<void(double)>; // percent
+
+private:
+  struct Segment {
+    CURL *handle = nullptr;
+    int fd = -1;
+    curl_off_t start = 0;
+    curl_off_t end = 0; // inclusive; -1 = until EOF (single request)
+    curl_off_t written = 0;
+    int attempts = 0;
+    bool write_failed = false;
+    bool overrun = false; // server sent more than the requested range
+  };
+
+  // Slices below this are not worth their own connection
+  static constexpr curl_off_t MIN_SEGMENT = 1024 * 1024;
+  static constexpr int MAX_SEGMENT_ATTEMPTS = 3;
+
+  int connections;
+
+  // Total receive budget in bytes/s, polled during the transfer; 0 or
+  // unset = unlimited
+  std::function<int64_t()> rate_limit;
+  curl_off_t segment_limit = 0; // currently applied to each handle
+
+  static size_t write_segment(char *data, size_t size, size_t nmemb, void *userp) {
+    auto *seg = static_cast<Segment *>(userp);
+    size_t len = size * nmemb;
+    if (seg->end >= 0 && seg->start + seg->written + static_cast<curl_off_t>(len) > seg->end + 1) {
+      seg->overrun = true;
+      return 0;
+    }
+    size_t done = 0;
+    while (done < len) {
+      ssize_t n = pwrite(seg->fd, data + done, len - done, seg->start + seg->written);
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        seg->write_failed = true;
+        return 0; // aborts the transfer
+      }
+      done += n;
+      seg->written += n;
+    }
+    return len;
+  }
+
+  static size_t header_callback(char *data, size_t size, size_t nitems, void *userp) {
+    size_t len = size * nitems;
+    std::string line(data, len);
+    std::transform(line.begin(), line.end(), line.begin(), ::tolower);
+    if (line.rfind("accept-ranges:", 0) == 0 && line.find("bytes") != std::string::npos) {
+      *static_cast<bool *>(userp) = true;
+    }
+    return len;
+  }
+
+  static void common_options(CURL *handle, const std::string &url) {
+    curl_easy_setopt(handle, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(handle, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(handle, CURLOPT_USERAGENT, "Mozilla/5.0");
+    curl_easy_setopt(handle, CURLOPT_CONNECTTIMEOUT, 15L);
+    // Give up on a connection stalled below 1 KB/s for 30 s
+    curl_easy_setopt(handle, CURLOPT_LOW_SPEED_LIMIT, 1024L);
+    curl_easy_setopt(handle, CURLOPT_LOW_SPEED_TIME, 30L);
+    curl_easy_setopt(handle, CURLOPT_FAILONERROR, 1L);
+  }
+
+  // Content length and range support, from a HEAD request
+  static bool probe(const std::string &url, curl_off_t &length, bool &ranges) {
+    CURL *handle = curl_easy_init();
+    if (!handle) {
+      return false;
+    }
+    common_options(handle, url);
+    curl_easy_setopt(handle, CURLOPT_NOBODY, 1L);
+    curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION, header_callback);
+    curl_easy_setopt(handle, CURLOPT_HEADERDATA, &ranges);
+    CURLcode res = curl_easy_perform(handle);
+    length = -1;
+    if (res == CURLE_OK) {
+      curl_easy_getinfo(handle, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
+    }
+    curl_easy_cleanup(handle);
+    return res == CURLE_OK;
+  }
+
+  // Set up (or re-arm after a failure) the transfer for the rest of seg
+  void arm(Segment &seg, const std::string &url) {
+    if (seg.handle) {
+      curl_easy_cleanup(seg.handle);
+    }
+    seg.handle = curl_easy_init();
+    common_options(seg.handle, url);
+    curl_easy_setopt(seg.handle, CURLOPT_WRITEFUNCTION, write_segment);
+    curl_easy_setopt(seg.handle, CURLOPT_WRITEDATA, &seg);
+    curl_easy_setopt(seg.handle, CURLOPT_PRIVATE, &seg);
+    curl_easy_setopt(seg.handle, CURLOPT_MAX_RECV_SPEED_LARGE, segment_limit);
+    if (seg.end >= 0) {
+      std::string range =
+          std::to_string(seg.start + seg.written) + "-" + std::to_string(seg.end);
+      curl_easy_setopt(seg.handle, CURLOPT_RANGE, range.c_str());
+    }
+    seg.attempts++;
+  }
+
+public:
+  explicit SegmentedDownloader(int parallel = 4)
+      : connections(std::clamp(parallel, 1, 16)) {}
+
+  void set_rate_limit(std::function<int64_t()> limit) { rate_limit = std::move(limit); }
+
+  // True for URLs that point at a media file rather than a web page
+  // needing extraction
+  static bool is_direct_media_url(const std::string &url) {
+    if (url.rfind("http://", 0) != 0 && url.rfind("https://", 0) != 0) {
+      return false;
+    }
+    std::string path = url.substr(0, url.find_first_of("?#"));
+    std::string ext = extension_of(path);
+    static const char *media[] = {"mp3", "mp4", "m4a", "aac", "opus",
+                                  "ogg", "webm", "flac", "wav"};
+    return std::find(std::begin(media), std::end(media), ext) != std::end(media);
+  }
+
+  // Lower-case extension of the last path component, without the dot
+  static std::string extension_of(const std::string &path) {
+    auto slash = path.find_last_of('/');
+    auto dot = path.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+      return "";
+    }
+    std::string ext = path.substr(dot + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext;
+  }
+
+  // Download url into path. Stops early once keep_going turns false.
+  bool download(const std::string &url, const std::string &path,
+                const std::atomic_bool &keep_going, const ProgressFn &progress,
+                std::string &error) {
+    curl_off_t length = -1;
+    bool ranges = false;
+    if (!probe(url, length, ranges)) {
+      error = "could not reach " + url;
+      return false;
+    }
+
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+      error = "cannot open " + path + ": " + strerror(errno);
+      return false;
+    }
+
+    // Split into slices, one connection each
+    std::vector<Segment> segments;
+    if (length > 0 && ranges) {
+      int count = static_cast<int>(
+          std::clamp<curl_off_t>(length / MIN_SEGMENT, 1, connections));
+      curl_off_t slice = length / count;
+      segments.resize(count);
+      for (int i = 0; i < count; i++) {
+        segments[i].start = i * slice;
+        segments[i].end = i == count - 1 ? length - 1 : (i + 1) * slice - 1;
+      }
+      // Reserve the whole file up front so slices land without extending it
+      if (posix_fallocate(fd, 0, length) != 0 && ftruncate(fd, length) != 0) {
+        close(fd);
+        error = std::string("cannot allocate ") + path + ": " + strerror(errno);
+        return false;
+      }
+    } else {
+      segments.resize(1);
+      segments[0].end = -1;
+    }
+
+    CURLM *multi = curl_multi_init();
+    for (auto &seg : segments) {
+      seg.fd = fd;
+      arm(seg, url);
+      curl_multi_add_handle(multi, seg.handle);
+    }
+
+    bool ok = true;
+    int active = static_cast<int>(segments.size());
+    while (active > 0 && ok) {
+      if (!keep_going) {
+        error = "cancelled";
+        ok = false;
+        break;
+      }
+      if (rate_limit) {
+        // Split the budget over the slices; libcurl picks the new limit up
+        // mid-transfer
+        curl_off_t limit = rate_limit() / static_cast<curl_off_t>(segments.size());
+        if (limit != segment_limit) {
+          segment_limit = limit;
+          for (auto &seg : segments) {
+            curl_easy_setopt(seg.handle, CURLOPT_MAX_RECV_SPEED_LARGE, segment_limit);
+          }
+        }
+      }
+      curl_multi_perform(multi, &active);
+
+      int queued;
+      while (CURLMsg *msg = curl_multi_info_read(multi, &queued)) {
+        if (msg->msg != CURLMSG_DONE) {
+          continue;
+        }
+        Segment *seg = nullptr;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &seg);
+        curl_multi_remove_handle(multi, msg->easy_handle);
+
+        bool complete = seg->end < 0 ? msg->data.result == CURLE_OK
+                                     : seg->start + seg->written > seg->end;
+        if (complete) {
+          continue;
+        }
+        if (seg->overrun || seg->write_failed || seg->attempts >= MAX_SEGMENT_ATTEMPTS) {
+          error = seg->overrun        ? std::string("server ignored the range request")
+                  : seg->write_failed ? std::string("write failed: ") + strerror(errno)
+                                      : std::string(curl_easy_strerror(msg->data.result));
+          ok = false;
+          break;
+        }
+        // Ranged slices pick up where they stopped; a plain request restarts
+        if (seg->end < 0) {
+          seg->written = 0;
+          if (ftruncate(fd, 0) != 0) {
+            error = strerror(errno);
+            ok = false;
+            break;
+          }
+        }
+        arm(*seg, url);
+        curl_multi_add_handle(multi, seg->handle);
+        active++;
+      }
+
+      if (progress && length > 0) {
+        curl_off_t done = 0;
+        for (const auto &seg : segments) {
+          done += seg.written;
+        }
+        progress(100.0 * done / length);
+      }
+      if (active > 0 && ok) {
+        curl_multi_poll(multi, nullptr, 0, 250, nullptr);
+      }
+    }
+
+    for (auto &seg : segments) {
+      if (seg.handle) {
+        curl_multi_remove_handle(multi, seg.handle);
+        curl_easy_cleanup(seg.handle);
+      }
+    }
+    curl_multi_cleanup(multi);
+    close(fd);
+
+    if (!ok) {
+      unlink(path.c_str());
+    }
+    return ok;
+  }
+};
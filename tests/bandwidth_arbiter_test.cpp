@@ -0,0 +1,69 @@
+// BandwidthArbiter: the throttle is released once the buffer is as full as
+// the player will make it
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "../src/core/bandwidth_arbiter.hpp"
+#include "check.hpp"
+
+namespace {
+
+// Polls `condition` for up to `timeout`
+template <typename Condition>
+bool eventually(Condition condition, std::chrono::milliseconds timeout) {
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  while (std::chrono::steady_clock::now() < deadline) {
+    if (condition()) {
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+  return condition();
+}
+
+// Default throttle_below_secs against readahead walked down to its floor:
+// the buffer never gets near three times the low watermark
+void released_at_readahead_plateau() {
+  std::atomic<double> ahead{3.0};
+  const double target = 10.0;
+  BandwidthArbiter arbiter([&] { return BandwidthArbiter::Buffer{ahead.load(), target}; }, 10.0,
+                           64);
+  std::atomic<int> changes{0};
+  arbiter.add_listener([&](bool) { changes++; });
+  arbiter.start();
+
+  CHECK(eventually([&] { return arbiter.is_throttled(); }, std::chrono::seconds(3)));
+  CHECK(arbiter.transfer_limit() > 0);
+
+  // Buffered up to just under the readahead target, where it stays
+  ahead = target - 0.5;
+  CHECK(eventually([&] { return !arbiter.is_throttled(); }, std::chrono::seconds(3)));
+  CHECK(arbiter.transfer_limit() == 0);
+  CHECK(changes == 2);
+  arbiter.stop();
+}
+
+void hysteresis() {
+  using Buffer = BandwidthArbiter::Buffer;
+  // Unknown target: release at three times the low watermark
+  CHECK(BandwidthArbiter::next_state(false, Buffer{5.0, 0.0}, 10.0));
+  CHECK(BandwidthArbiter::next_state(true, Buffer{25.0, 0.0}, 10.0));
+  CHECK(!BandwidthArbiter::next_state(true, Buffer{30.0, 0.0}, 10.0));
+  // Between the watermarks the state holds
+  CHECK(!BandwidthArbiter::next_state(false, Buffer{12.0, 20.0}, 10.0));
+  CHECK(BandwidthArbiter::next_state(true, Buffer{12.0, 20.0}, 10.0));
+  // Plateau at the start target releases
+  CHECK(!BandwidthArbiter::next_state(true, Buffer{19.0, 20.0}, 10.0));
+  // Nothing streaming never throttles
+  CHECK(!BandwidthArbiter::next_state(true, Buffer{-1.0, 20.0}, 10.0));
+}
+
+} // namespace
+
+int main() {
+  hysteresis();
+  released_at_readahead_plateau();
+  return 0;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+
+// Minimal checks for the test programs: the first failure prints where it
+// happened and exits non-zero, which is all ctest looks at. Unlike assert
+// these stay on in release builds.
+#define CHECK(condition)                                                          \
+  do {                                                                            \
+    if (!(condition)) {                                                           \
+      std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,      \
+                   #condition);                                                   \
+      std::exit(1);                                                               \
+    }                                                                             \
+  } while (0)
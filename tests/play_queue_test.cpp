@@ -0,0 +1,66 @@
+// PlayQueue: replacing the contents keeps history consistent
+
+#include <string>
+#include <vector>
+
+#include "../src/audio/play_queue.hpp"
+#include "check.hpp"
+
+namespace {
+
+std::vector<Track> tracks(const std::string &prefix, int count) {
+  std::vector<Track> out;
+  for (int i = 0; i < count; i++) {
+    Track track;
+    track.name = prefix + std::to_string(i);
+    track.url = "https://example.com/" + track.name;
+    out.push_back(track);
+  }
+  return out;
+}
+
+// A shorter list over a queue positioned past its end
+void assign_shorter_list() {
+  PlayQueue queue;
+  queue.assign(tracks("old", 5), 4);
+  CHECK(queue.current_index() == 4);
+
+  queue.assign(tracks("new", 1));
+  CHECK(queue.size() == 1);
+  CHECK(queue.current_index() == 0);
+  CHECK(queue.current_track()->name == "new0");
+
+  // The track that was playing, not one from the new list
+  auto history = queue.get_history();
+  CHECK(!history.empty());
+  CHECK(history.back()->name == "old4");
+}
+
+// A list long enough that the old index is still valid
+void assign_same_length() {
+  PlayQueue queue;
+  queue.assign(tracks("old", 3), 1);
+  queue.assign(tracks("new", 3), 2);
+  auto history = queue.get_history();
+  CHECK(!history.empty());
+  CHECK(history.back()->name == "old1");
+  CHECK(queue.current_track()->name == "new2");
+}
+
+void assign_after_clear() {
+  PlayQueue queue;
+  queue.assign(tracks("old", 2), 1);
+  size_t before = queue.get_history().size();
+  queue.clear();
+  queue.assign(tracks("new", 2));
+  CHECK(queue.get_history().size() == before);
+}
+
+} // namespace
+
+int main() {
+  assign_shorter_list();
+  assign_same_length();
+  assign_after_clear();
+  return 0;
+}